@@ -0,0 +1,154 @@
+#ifndef TRITIUM_TOKENS
+#define TRITIUM_TOKENS
+
+#include "../include/munchar.hpp"
+#include "../include/munchar_tokens.hpp"
+#include "../include/munchar_keywords.hpp"
+#include <cctype>
+
+namespace Tritium {
+  using namespace Munchar;
+  using namespace Munchar::Tokens;
+
+  constexpr auto directive     = CHR('@') ^ *id_body;
+  constexpr auto ts_identifier = +CHR('$') | (id_start ^ *(id_body | CHR('$')));
+  constexpr auto ts_word       = id_start ^ *id_body;
+  constexpr auto attr_name     = (id_start | colon) ^ *(id_body | CLS("-.")) ^ colon;
+  constexpr auto type_name     = P(::isupper) ^ *id_body;
+  constexpr auto gvar          = CHR('$') ^ +id_body;
+  constexpr auto lvar          = CHR('%') ^ +id_body;
+  constexpr auto ts_path       = +(id_body | CLS("-+.*?:\\/"));
+  constexpr auto slash_regexp  = slash ^ *(escape_seq | (!CLS("/\\") ^ _)) ^ slash ^ *CLS("imxouesn");
+  constexpr auto bq_regexp     = backquote ^ *(escape_seq | (!CLS("`\\") ^ _)) ^ backquote ^ *CLS("imxouesn");
+
+  enum Tritium_Token {
+    LPAREN, RPAREN, LBRACE, RBRACE,
+    COMMA, DOT, EQUAL, PLUS,
+    STRING, REGEXP, POS,
+    GVAR, LVAR,
+    KWD, ID, TYPE, PATH,
+    NS, OPEN, FUNC, IMPORT, OPTIONAL,
+    READ,
+    COMMENT,
+    SEMI, SPACE
+  };
+
+  const char* const token_names[] = {
+    "LPAREN", "RPAREN", "LBRACE", "RBRACE",
+    "COMMA", "DOT", "EQUAL", "PLUS",
+    "STRING", "REGEXP", "POS",
+    "GVAR", "LVAR",
+    "KWD", "ID", "TYPE", "PATH",
+    "NS", "OPEN", "FUNC", "IMPORT", "OPTIONAL",
+    "READ",
+    "COMMENT",
+    "SEMI", "SPACE"
+  };
+
+  inline const Keyword_Table& directives() {
+    static const Keyword_Table t {
+      { "@import", IMPORT }, { "@optional", OPTIONAL }, { "@func", FUNC },
+      { "@namespace", NS }, { "@open", OPEN }
+    };
+    return t;
+  }
+
+  inline const Keyword_Table& keywords() {
+    static const Keyword_Table t {
+      { "read", READ },
+      { "top", POS }, { "bottom", POS }, { "before", POS }, { "after", POS }
+    };
+    return t;
+  }
+
+  // Scans one token of [b, e), dispatching on its first byte, and sets its
+  // kind; whitespace, semicolons and comments are tokens too, so a file is
+  // exactly the concatenation of its tokens. Returns null on a lexing error.
+  struct Scanner {
+    const char* operator()(const char* b, const char* e, int& kind) const {
+      const char* p;
+      switch (*b) {
+        case ';': {
+          kind = SEMI;
+          return b+1;
+        }
+
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r': {
+          kind = SPACE;
+          return whitespace(b, e);
+        }
+
+        case '/': {
+          if ((p = c_comment(b, e)) || (p = cpp_comment(b, e))) kind = COMMENT;
+          else if ((p = slash_regexp(b, e))) kind = REGEXP;
+          return p;
+        }
+
+        case '#': {
+          kind = COMMENT;
+          return sh_comment(b, e);
+        }
+
+        case '@': {
+          if (!(p = directives().scan(directive, b, e, kind)) || kind == Keyword_Table::none) return nullptr;
+          return p;
+        }
+
+        case '"':
+        case '\'': {
+          kind = STRING;
+          return Tokens::string(b, e);
+        }
+
+        case '`': {
+          kind = REGEXP;
+          return bq_regexp(b, e);
+        }
+
+        case '+': kind = PLUS;   return b+1;
+        case '(': kind = LPAREN; return b+1;
+        case ')': kind = RPAREN; return b+1;
+        case '{': kind = LBRACE; return b+1;
+        case '}': kind = RBRACE; return b+1;
+        case '.': kind = DOT;    return b+1;
+        case ',': kind = COMMA;  return b+1;
+        case '=': kind = EQUAL;  return b+1;
+
+        case '$': {
+          if ((p = gvar(b, e))) {
+            kind = GVAR;
+            return p;
+          }
+          kind = ID;
+          return ts_identifier(b, e);
+        }
+
+        case '%': {
+          kind = LVAR;
+          return lvar(b, e);
+        }
+
+        default: {
+          if ((p = attr_name(b, e))) kind = KWD;
+          else if ((p = type_name(b, e))) kind = TYPE;
+          else if ((p = keywords().scan(ts_word, colon, b, e, kind))) {
+            // Keywords end where a word can't go on, so `read$x` is READ
+            // then `$x`; an identifier may go on with '$'.
+            if (kind == Keyword_Table::none) {
+              kind = ID;
+              p = (*(id_body | CHR('$')))(p, e);
+            }
+          }
+          else if ((p = number(b, e))) kind = STRING;
+          return p;
+        }
+      }
+    }
+  };
+
+}
+
+#endif
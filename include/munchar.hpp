@@ -2,40 +2,173 @@
 #define MUNCHAR
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 namespace Munchar {
 
+  // Set of bytes that may begin a match. Every matcher exposes a member
+  // `bool first(Byte_Set& s) const` which adds the bytes it may start with to
+  // `s` and returns whether it can succeed without consuming anything. The
+  // result is a conservative superset, used to skip ahead when searching.
+  //
+  // Matchers also expose `template<typename P> bool compile(P& p) const`,
+  // which describes the matcher to a compiler `p` (see munchar_batch.hpp) in
+  // terms of single-byte classes, literals, repetition and alternation, and
+  // returns false when the matcher cannot be expressed that way.
+  //
+  // Besides the bounded and NUL-terminated forms, every matcher can be called
+  // as `m(b, e, ctx)`, which threads a context object through the match for
+  // combinators that record something on success (captures, actions, tree
+  // nodes). A context provides `mark()`, returning a snapshot of whatever it
+  // has recorded, and `rollback(mark)`, which discards everything recorded
+  // since. Combinators that carry on after a failed sub-match (alternation,
+  // repetition, lookahead) roll back the failed attempt, so only effects of
+  // the successful path remain. If the whole match fails, the context's
+  // contents are unspecified.
+
+  class Byte_Set {
+    uint64_t bits_[4];
+  public:
+    Byte_Set() : bits_() { }
+    void add(unsigned char c) {
+      bits_[c >> 6] |= uint64_t(1) << (c & 63);
+    }
+    void fill() {
+      bits_[0] = bits_[1] = bits_[2] = bits_[3] = ~uint64_t(0);
+    }
+    bool has(unsigned char c) const {
+      return (bits_[c >> 6] >> (c & 63)) & 1;
+    }
+    size_t count() const {
+      size_t n = 0;
+      for (size_t c = 0; c < 256; ++c) n += has(c);
+      return n;
+    }
+  };
+
+  // Matchers are templates on the input position, so the same rule runs
+  // over `const char*`, `const char16_t*` or `const char32_t*` input without
+  // transcoding, or over any iterator that behaves enough like a pointer:
+  // comparison, dereference, increment and decrement, adding and subtracting
+  // offsets, and a null value for failure (see munchar_rope.hpp). Pattern and
+  // input characters are compared as code unit values, with plain chars
+  // taken as unsigned bytes. Byte-oriented facilities (first-byte sets,
+  // compilation, searching with memchr) are only exact for char input.
+
+  namespace Util {
+    constexpr uint32_t unit(char c) {
+      return static_cast<unsigned char>(c);
+    }
+    constexpr uint32_t unit(signed char c) {
+      return static_cast<unsigned char>(c);
+    }
+    template<typename C>
+    constexpr uint32_t unit(C c) {
+      return c;
+    }
+
+    // Matches `m` backwards from `e` within input that really ends at `end`;
+    // only combinators take `end` (see Lookahead), so other matchers are
+    // called without it.
+    template<typename M, typename It>
+    auto reverse(const M& m, It b, It e, It end, int) -> decltype(m.reverse(b, e, end)) {
+      return m.reverse(b, e, end);
+    }
+    template<typename M, typename It>
+    It reverse(const M& m, It b, It e, It end, long) {
+      return m.reverse(b, e);
+    }
+    template<typename M, typename It>
+    It reverse(const M& m, It b, It e, It end) {
+      return reverse(m, b, e, end, 0);
+    }
+  }
+
   // Unconditional success
 
   struct Success {
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return b;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return b;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return e;
+    }
+    bool first(Byte_Set& s) const {
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return true;
+    }
   };
 
   // Unconditional failure
 
   struct Failure {
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
   };
 
   // Arbitrary character
 
   struct Any_Char {
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return b < e ? b+1 : nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return *b ? b+1 : nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return b < e ? e-1 : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      s.fill();
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
   };
 
   // Character constant
@@ -44,11 +177,29 @@ namespace Munchar {
     const char c_;
   public:
     constexpr Char(const char c) : c_(c) { }
-    const char* operator()(const char* b, const char* e) const {
-      return b < e && *b == c_ ? b+1 : nullptr;
+    template<typename It>
+    It operator()(It b, It e) const {
+      return b < e && Util::unit(*b) == Util::unit(c_) ? b+1 : nullptr;
     }
-    const char* operator()(const char* b) const {
-      return *b && *b == c_ ? b+1 : nullptr;
+    template<typename It>
+    It operator()(It b) const {
+      return *b && Util::unit(*b) == Util::unit(c_) ? b+1 : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return b < e && Util::unit(e[-1]) == Util::unit(c_) ? e-1 : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      s.add(c_);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
     }
   };
 
@@ -69,20 +220,46 @@ namespace Munchar {
     size_t len_;
   public:
     constexpr Str(const Ptr& s, size_t len) : s_(s), len_(len) { }
-    const char* operator()(const char* b, const char* e) const {
+    constexpr Ptr data() const { return s_; }
+    constexpr size_t size() const { return len_; }
+    template<typename It>
+    It operator()(It b, It e) const {
       Ptr s = s_;
       for (size_t i = 0; i < len_; ++i, ++b, ++s) {
-        if (!(b < e) || (*s != *b)) return nullptr;
+        if (!(b < e) || (Util::unit(*s) != Util::unit(*b))) return nullptr;
       }
       return b;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       Ptr s = s_;
       for (size_t i = 0; i < len_; ++i, ++b, ++s) {
-        if (!*b || (*s != *b)) return nullptr;
+        if (!*b || (Util::unit(*s) != Util::unit(*b))) return nullptr;
       }
       return b;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      if (size_t(e-b) < len_) return nullptr;
+      Ptr s = s_ + len_;
+      for (size_t i = 0; i < len_; ++i) if (Util::unit(*--s) != Util::unit(*--e)) return nullptr;
+      return e;
+    }
+    bool first(Byte_Set& s) const {
+      if (!len_) return true;
+      s.add(*s_);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      Ptr s = s_;
+      for (size_t i = 0; i < len_; ++i, ++s) if (!p.bytes(Char { *s })) return false;
+      return true;
+    }
   };
 
   template<typename Ptr>
@@ -90,14 +267,44 @@ namespace Munchar {
     Ptr s_;
   public:
     constexpr Str(const Ptr& s) : s_(s) { }
-    const char* operator()(const char* b, const char* e) const {
-      for (Ptr s = s_; *s; ++b, ++s) if (!(b < e) || (*s != *b)) return nullptr;
+    constexpr Ptr data() const { return s_; }
+    size_t size() const {
+      size_t n = 0;
+      for (Ptr s = s_; *s; ++s) ++n;
+      return n;
+    }
+    template<typename It>
+    It operator()(It b, It e) const {
+      for (Ptr s = s_; *s; ++b, ++s) if (!(b < e) || (Util::unit(*s) != Util::unit(*b))) return nullptr;
       return b;
     }
-    const char* operator()(const char* b) const {
-      for (Ptr s = s_; *s; ++b, ++s) if (!*b || (*s != *b)) return nullptr;
+    template<typename It>
+    It operator()(It b) const {
+      for (Ptr s = s_; *s; ++b, ++s) if (!*b || (Util::unit(*s) != Util::unit(*b))) return nullptr;
       return b;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      size_t len = size();
+      if (size_t(e-b) < len) return nullptr;
+      Ptr s = s_ + len;
+      for (size_t i = 0; i < len; ++i) if (Util::unit(*--s) != Util::unit(*--e)) return nullptr;
+      return e;
+    }
+    bool first(Byte_Set& s) const {
+      if (!*s_) return true;
+      s.add(*s_);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      for (Ptr s = s_; *s; ++s) if (!p.bytes(Char { *s })) return false;
+      return true;
+    }
   };
 
   // Commenting this out because GCC 4.6 doesn't support it.
@@ -119,7 +326,8 @@ namespace Munchar {
     return Str<Ptr, false> { s };
   }
 
-  // Character class
+  // Character class, scanned linearly; see munchar_classes.hpp for large
+  // classes of wide code units.
 
   template<typename Ptr = const char*, bool with_len = true>
   class Char_Class {
@@ -127,18 +335,40 @@ namespace Munchar {
     size_t len_;
   public:
     constexpr Char_Class(const Ptr& s, size_t len) : s_(s), len_(len) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       if (!(b < e)) return nullptr;
       Ptr s = s_;
-      for (size_t i = 0; i < len_; ++i, ++s) if (*s == *b) return b+1;
+      for (size_t i = 0; i < len_; ++i, ++s) if (Util::unit(*s) == Util::unit(*b)) return b+1;
       return nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       if (!*b) return nullptr;
       Ptr s = s_;
-      for (size_t i = 0; i < len_; ++i, ++s) if (*s == *b) return b+1;
+      for (size_t i = 0; i < len_; ++i, ++s) if (Util::unit(*s) == Util::unit(*b)) return b+1;
+      return nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      if (!(b < e)) return nullptr;
+      Ptr s = s_;
+      for (size_t i = 0; i < len_; ++i, ++s) if (Util::unit(*s) == Util::unit(e[-1])) return e-1;
       return nullptr;
     }
+    bool first(Byte_Set& s) const {
+      Ptr p = s_;
+      for (size_t i = 0; i < len_; ++i, ++p) s.add(*p);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
   };
 
   template<typename Ptr>
@@ -146,16 +376,36 @@ namespace Munchar {
     Ptr s_;
   public:
     constexpr Char_Class(const Ptr& s) : s_(s) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       if (!(b < e)) return nullptr;
-      for (Ptr s = s_; *s; ++s) if (*s == *b) return b+1;
+      for (Ptr s = s_; *s; ++s) if (Util::unit(*s) == Util::unit(*b)) return b+1;
       return nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       if (!*b) return nullptr;
-      for (Ptr s = s_; *s; ++s) if (*s == *b) return b+1;
+      for (Ptr s = s_; *s; ++s) if (Util::unit(*s) == Util::unit(*b)) return b+1;
       return nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      if (!(b < e)) return nullptr;
+      for (Ptr s = s_; *s; ++s) if (Util::unit(*s) == Util::unit(e[-1])) return e-1;
+      return nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      for (Ptr p = s_; *p; ++p) s.add(*p);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
   };
 
   // Commenting this out because GCC 4.6 doesn't support it.
@@ -177,18 +427,231 @@ namespace Munchar {
     return Char_Class<Ptr, false> { s };
   }
 
-  // Predicate
+  // Case-insensitive character, string and class constants. Only ASCII
+  // letters are folded. Folding a byte is a single OR with 0x20 once it's
+  // known to be a letter, so strings are compared eight bytes at a time
+  // with a per-word mask that has 0x20 in each letter position of the
+  // pattern: (input | mask) == (pattern | mask).
+
+  namespace Util {
+    constexpr bool is_upper(char c) {
+      return c >= 'A' && c <= 'Z';
+    }
+    constexpr bool is_lower(char c) {
+      return c >= 'a' && c <= 'z';
+    }
+    constexpr char fold(char c) {
+      return is_upper(c) ? char(c | 0x20) : c;
+    }
+    constexpr char unfold(char c) {
+      return is_lower(c) ? char(c & ~0x20) : c;
+    }
+    constexpr uint32_t fold_unit(uint32_t c) {
+      return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+    }
+    constexpr size_t length(const char* s) {
+      return *s ? 1 + length(s+1) : 0;
+    }
+    // 0x20 in each byte of `w` that is an ASCII letter.
+    inline uint64_t letter_mask(uint64_t w) {
+      uint64_t l = w | 0x2020202020202020ull;
+      uint64_t ascii = ~w & 0x8080808080808080ull;
+      uint64_t ge_a = (l & 0x7F7F7F7F7F7F7F7Full) + 0x1F1F1F1F1F1F1F1Full;
+      uint64_t gt_z = (l & 0x7F7F7F7F7F7F7F7Full) + 0x0505050505050505ull;
+      return ((ge_a & ~gt_z & ascii) >> 2) & 0x2020202020202020ull;
+    }
+  }
+
+  class IChar {
+    const char c_;
+  public:
+    constexpr IChar(const char c) : c_(Util::fold(c)) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return b < e && Util::fold_unit(Util::unit(*b)) == Util::unit(c_) ? b+1 : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return *b && Util::fold_unit(Util::unit(*b)) == Util::unit(c_) ? b+1 : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return b < e && Util::fold_unit(Util::unit(e[-1])) == Util::unit(c_) ? e-1 : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      s.add(c_);
+      s.add(Util::unfold(c_));
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
+  };
+
+  constexpr IChar ICHR(const char c) {
+    return IChar { c };
+  }
+
+  class IStr {
+    const char* s_;
+    size_t len_;
+    template<typename C>
+    static bool same(C c, char p) {
+      return Util::fold_unit(Util::unit(c)) == Util::fold_unit(Util::unit(p));
+    }
+    // How much of the pattern matches eight bytes at a time from `b`, or
+    // len_+1 on a mismatch. Only byte pointers take the word path.
+    template<typename It>
+    size_t words(It b, std::true_type) const {
+      size_t i = 0;
+      for (uint64_t w, x, m; len_-i >= 8; i += 8) {
+        memcpy(&w, b+i, 8);
+        memcpy(&x, s_+i, 8);
+        m = Util::letter_mask(x);
+        if ((w | m) != (x | m)) return len_+1;
+      }
+      return i;
+    }
+    template<typename It>
+    size_t words(It b, std::false_type) const {
+      return 0;
+    }
+  public:
+    constexpr IStr(const char* s, size_t len) : s_(s), len_(len) { }
+    constexpr const char* data() const { return s_; }
+    constexpr size_t size() const { return len_; }
+    template<typename It>
+    It operator()(It b, It e) const {
+      size_t i = 0;
+      if (std::is_pointer<It>::value) {
+        if (size_t(e-b) < len_) return nullptr;
+        i = words(b, std::integral_constant<bool, std::is_pointer<It>::value && sizeof(*b) == 1>());
+        if (i > len_) return nullptr;
+        b += i;
+      }
+      for (; i < len_; ++i, ++b) if (!(b < e) || !same(*b, s_[i])) return nullptr;
+      return b;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      for (size_t i = 0; i < len_; ++i, ++b) {
+        if (!*b || !same(*b, s_[i])) return nullptr;
+      }
+      return b;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      if (size_t(e-b) < len_) return nullptr;
+      return (*this)(e-len_, e) ? e-len_ : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      if (!len_) return true;
+      return IChar { *s_ }.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      for (size_t i = 0; i < len_; ++i) if (!p.bytes(IChar { s_[i] })) return false;
+      return true;
+    }
+  };
+
+  constexpr IStr ISTR(const char* s) {
+    return IStr { s, Util::length(s) };
+  }
+
+  constexpr IStr ISTR(const char* s, size_t len) {
+    return IStr { s, len };
+  }
+
+  class IChar_Class {
+    const char* s_;
+    template<typename C>
+    bool has(C c) const {
+      uint32_t u = Util::fold_unit(Util::unit(c));
+      for (const char* s = s_; *s; ++s) if (Util::fold_unit(Util::unit(*s)) == u) return true;
+      return false;
+    }
+  public:
+    constexpr IChar_Class(const char* s) : s_(s) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return b < e && has(*b) ? b+1 : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return *b && has(*b) ? b+1 : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return b < e && has(e[-1]) ? e-1 : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      for (const char* p = s_; *p; ++p) IChar { *p }.first(s);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
+  };
+
+  constexpr IChar_Class ICLS(const char* s) {
+    return IChar_Class { s };
+  }
+
+  // Predicate. Predicates are byte classifiers in the style of <cctype>:
+  // they are called with code units as unsigned char values, and code units
+  // above 0xFF don't satisfy them (see munchar_classes.hpp for classes of
+  // wide code units).
+
+  namespace Util {
+    template<typename I, typename O>
+    bool test(O (*p)(I), uint32_t u) {
+      return u <= 0xFF && p(I(static_cast<unsigned char>(u)));
+    }
+  }
 
   template<typename I, typename O, bool is_static = false>
   class Predicate {
     O (*const p_)(I);
   public:
     constexpr Predicate(O(p)(I)) : p_(p) { }
-    const char* operator()(const char* b, const char* e) const {
-      return (b < e) && p_(*b) ? b+1 : nullptr;
+    template<typename It>
+    It operator()(It b, It e) const {
+      return (b < e) && Util::test(p_, Util::unit(*b)) ? b+1 : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return *b && Util::test(p_, Util::unit(*b)) ? b+1 : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return (b < e) && Util::test(p_, Util::unit(e[-1])) ? e-1 : nullptr;
     }
-    const char* operator()(const char* b) const {
-      return *b && p_(*b) ? b+1 : nullptr;
+    bool first(Byte_Set& s) const {
+      for (size_t c = 0; c < 256; ++c) if (Util::test(p_, c)) s.add(c);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
     }
   };
 
@@ -196,11 +659,29 @@ namespace Munchar {
   class Predicate<I, O, true> {
     template<O(p_)(I)>
     struct Static {
-      const char* operator()(const char* b, const char* e) const {
-        return (b < e) && p_(*b) ? b+1 : nullptr;
+      template<typename It>
+      It operator()(It b, It e) const {
+        return (b < e) && Util::test(p_, Util::unit(*b)) ? b+1 : nullptr;
+      }
+      template<typename It>
+      It operator()(It b) const {
+        return *b && Util::test(p_, Util::unit(*b)) ? b+1 : nullptr;
+      }
+      template<typename It, typename Ctx>
+      It operator()(It b, It e, Ctx& ctx) const {
+        return (*this)(b, e);
+      }
+      template<typename It>
+      It reverse(It b, It e) const {
+        return (b < e) && Util::test(p_, Util::unit(e[-1])) ? e-1 : nullptr;
+      }
+      bool first(Byte_Set& s) const {
+        for (size_t c = 0; c < 256; ++c) if (Util::test(p_, c)) s.add(c);
+        return false;
       }
-      const char* operator()(const char* b) const {
-        return *b && p_(*b) ? b+1 : nullptr;
+      template<typename P>
+      bool compile(P& p) const {
+        return p.bytes(*this);
       }
     };
   public:
@@ -239,11 +720,113 @@ namespace Munchar {
     const char* operator()(const char* b, const char* e = nullptr) const {
       return f(b, e);
     }
+    template<typename Ctx>
+    const char* operator()(const char* b, const char* e, Ctx& ctx) const {
+      return f(b, e);
+    }
+    bool first(Byte_Set& s) const {
+      s.fill();
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
   };
 
   #define MUNCHAR_STATIC_FUNCTION(f)\
   (Function<f> { })
 
+  // Forward references, for recursive rules. A rule can't name itself in its
+  // own initializer, so it names a tag instead: declare the tag, use
+  // `Rule<tag>` wherever the rule refers to itself, then bind the tag to the
+  // finished rule. The reference is a direct call to a static function that
+  // runs the rule, so it can be inlined like any other combinator.
+  //
+  //   MUNCHAR_DECLARE_RULE(parens_rule);
+  //   constexpr auto parens = CHR('(') ^ *(Rule<parens_rule> { } | !CLS("()") ^ _) ^ CHR(')');
+  //   MUNCHAR_DEFINE_RULE(parens_rule, parens);
+  //
+  // A nonzero `max_depth` makes the reference fail once it is nested more
+  // than that many times on the current thread, so hostile input can't
+  // exhaust the stack.
+
+  #define MUNCHAR_DECLARE_RULE(tag)\
+  struct tag {\
+    template<typename It>\
+    static It match(It b, It e);\
+    template<typename It>\
+    static It match(It b);\
+    template<typename It, typename Ctx>\
+    static It match(It b, It e, Ctx& ctx);\
+  }
+
+  #define MUNCHAR_DEFINE_RULE(tag, rule)\
+  template<typename It>\
+  inline It tag::match(It b, It e) {\
+    return (rule)(b, e);\
+  }\
+  template<typename It>\
+  inline It tag::match(It b) {\
+    return (rule)(b);\
+  }\
+  template<typename It, typename Ctx>\
+  inline It tag::match(It b, It e, Ctx& ctx) {\
+    return (rule)(b, e, ctx);\
+  }
+
+  template<typename Tag, size_t max_depth>
+  class Depth_Guard {
+    static size_t& depth() {
+      static thread_local size_t d = 0;
+      return d;
+    }
+  public:
+    Depth_Guard() { ++depth(); }
+    ~Depth_Guard() { --depth(); }
+    bool ok() const {
+      return depth() <= max_depth;
+    }
+  };
+
+  template<typename Tag>
+  class Depth_Guard<Tag, 0> {
+  public:
+    bool ok() const {
+      return true;
+    }
+  };
+
+  template<typename Tag, size_t max_depth = 0>
+  class Rule {
+  public:
+    template<typename It>
+    It operator()(It b, It e) const {
+      Depth_Guard<Tag, max_depth> g;
+      return g.ok() ? Tag::match(b, e) : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      Depth_Guard<Tag, max_depth> g;
+      return g.ok() ? Tag::match(b) : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      Depth_Guard<Tag, max_depth> g;
+      return g.ok() ? Tag::match(b, e, ctx) : nullptr;
+    }
+    // Recursing into the rule here could loop forever, so a reference may
+    // start with anything.
+    bool first(Byte_Set& s) const {
+      s.fill();
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
+  };
+
   // Base class for unary combinators
 
   template<typename M>
@@ -277,12 +860,33 @@ namespace Munchar {
     const R r_;
   public:
     constexpr Sequence(const L& l, const R& r) : l_(l), r_(r) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return (b = this->l_(b, e)) ? this->r_(b, e) : nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return (b = this->l_(b)) ? this->r_(b) : nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (b = this->l_(b, e, ctx)) ? this->r_(b, e, ctx) : nullptr;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return (e = Util::reverse(this->r_, b, e, end)) ? Util::reverse(this->l_, b, e, end) : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      return this->l_.first(s) && this->r_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return this->l_.compile(p) && this->r_.compile(p);
+    }
   };
 
   template<typename L, typename R>
@@ -298,14 +902,42 @@ namespace Munchar {
     const R r_;
   public:
     constexpr Alternation(const L& l, const R& r) : l_(l), r_(r) { }
-    const char* operator()(const char* b, const char* e) const {
-      const char* p = this->l_(b);
+    template<typename It>
+    It operator()(It b, It e) const {
+      It p = this->l_(b, e);
       return p ? p : this->r_(b, e);
     }
-    const char* operator()(const char* b) const {
-      const char* p = this->l_(b);
+    template<typename It>
+    It operator()(It b) const {
+      It p = this->l_(b);
       return p ? p : this->r_(b);
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      auto m = ctx.mark();
+      It p = this->l_(b, e, ctx);
+      if (p) return p;
+      ctx.rollback(m);
+      return this->r_(b, e, ctx);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      It p = Util::reverse(this->l_, b, e, end);
+      return p ? p : Util::reverse(this->r_, b, e, end);
+    }
+    bool first(Byte_Set& s) const {
+      bool l = this->l_.first(s);
+      bool r = this->r_.first(s);
+      return l || r;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.alternative(this->l_, this->r_);
+    }
   };
 
   template<typename L, typename R>
@@ -327,14 +959,45 @@ namespace Munchar {
     const M m_;
   public:
     constexpr Zero_Or_More(const M& m) : m_(m) { }
-    const char* operator()(const char* b, const char* e) const {
-      for (const char* p = b; (p = this->m_(b, e)); b = p) ;
+    template<typename It>
+    It operator()(It b, It e) const {
+      for (It p = b; (p = this->m_(b, e)); b = p) ;
       return b;
     }
-    const char* operator()(const char* b) const {
-      for (const char* p = b; (p = this->m_(b)); b = p) ;
+    template<typename It>
+    It operator()(It b) const {
+      for (It p = b; (p = this->m_(b)); b = p) ;
       return b;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      for (;;) {
+        auto m = ctx.mark();
+        It p = this->m_(b, e, ctx);
+        if (!p) {
+          ctx.rollback(m);
+          return b;
+        }
+        b = p;
+      }
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      for (It p = e; (p = Util::reverse(this->m_, b, e, end)); e = p) ;
+      return e;
+    }
+    bool first(Byte_Set& s) const {
+      this->m_.first(s);
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.repeat(this->m_, 0, size_t(-1));
+    }
   };
 
   template<typename M>
@@ -342,10 +1005,70 @@ namespace Munchar {
     return Zero_Or_More<M> { m };
   }
 
+  // Kept as its own combinator rather than `m ^ *m`, so that the reverse form
+  // still leaves the mandatory repetitions for the leftmost ones.
+
+  template<typename M>
+  class N_Or_More {
+    const M m_;
+    size_t n_;
+  public:
+    constexpr N_Or_More(const M& m, size_t n) : m_(m), n_(n) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      size_t i;
+      for (i = 0; i < n_ && (b = this->m_(b, e)); ++i) ;
+      if (i < n_) return nullptr;
+      for (It p = b; (p = this->m_(b, e)); b = p) ;
+      return b;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      size_t i;
+      for (i = 0; i < n_ && (b = this->m_(b)); ++i) ;
+      if (i < n_) return nullptr;
+      for (It p = b; (p = this->m_(b)); b = p) ;
+      return b;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      size_t i;
+      for (i = 0; i < n_ && (b = this->m_(b, e, ctx)); ++i) ;
+      if (i < n_) return nullptr;
+      for (;;) {
+        auto m = ctx.mark();
+        It p = this->m_(b, e, ctx);
+        if (!p) {
+          ctx.rollback(m);
+          return b;
+        }
+        b = p;
+      }
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      size_t i;
+      for (i = 0; i < n_ && (e = Util::reverse(this->m_, b, e, end)); ++i) ;
+      if (i < n_) return nullptr;
+      for (It p = e; (p = Util::reverse(this->m_, b, e, end)); e = p) ;
+      return e;
+    }
+    bool first(Byte_Set& s) const {
+      return this->m_.first(s) || !n_;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.repeat(this->m_, n_, size_t(-1));
+    }
+  };
+
   template<typename M>
-  constexpr auto operator+(const M& m)
-  -> decltype(m ^ *m) {
-    return m ^ *m;
+  constexpr N_Or_More<M> operator+(const M& m) {
+    return N_Or_More<M> { m, 1 };
   }
 
   // Bounded repetition
@@ -356,16 +1079,41 @@ namespace Munchar {
     size_t n_;
   public:
     constexpr Exactly_N_Times(const M& m, size_t n) : m_(m), n_(n) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       size_t i;
       for (i = 0; i < n_ && (b = this->m_(b, e)); ++i) ;
       return i == n_ ? b : nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       size_t i;
       for (i = 0; i < n_ && (b = this->m_(b)); ++i) ;
       return i == n_ ? b : nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      size_t i;
+      for (i = 0; i < n_ && (b = this->m_(b, e, ctx)); ++i) ;
+      return i == n_ ? b : nullptr;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      size_t i;
+      for (i = 0; i < n_ && (e = Util::reverse(this->m_, b, e, end)); ++i) ;
+      return i == n_ ? e : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      return !n_ || this->m_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.repeat(this->m_, n_, n_);
+    }
   };
 
   template<typename M>
@@ -374,15 +1122,13 @@ namespace Munchar {
   }
 
   template<typename M>
-  constexpr auto operator>(const M& m,  size_t n)
-  -> decltype((m == n) ^ +m) {
-    return (m == n) ^ +m;
+  constexpr N_Or_More<M> operator>(const M& m,  size_t n) {
+    return N_Or_More<M> { m, n+1 };
   }
 
   template<typename M>
-  constexpr auto operator>=(const M& m,  size_t n)
-  -> decltype((m == n) ^ *m) {
-    return (m == n) ^ *m;
+  constexpr N_Or_More<M> operator>=(const M& m,  size_t n) {
+    return N_Or_More<M> { m, n };
   }
 
   template<typename M>
@@ -410,12 +1156,36 @@ namespace Munchar {
     const M m_;
   public:
     constexpr Negation(const M& m) : m_(m) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return this->m_(b, e) ? nullptr : b;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return this->m_(b) ? nullptr : b;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      auto m = ctx.mark();
+      It p = this->m_(b, e, ctx);
+      ctx.rollback(m);
+      return p ? nullptr : b;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return this->m_(e, end) ? nullptr : e;
+    }
+    bool first(Byte_Set& s) const {
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
   };
 
   template<typename M>
@@ -430,12 +1200,36 @@ namespace Munchar {
     const M m_;
   public:
     constexpr Lookahead(const M& m) : m_(m) { }
-    const char* operator()(const char* b, const char* e) const {
+    template<typename It>
+    It operator()(It b, It e) const {
       return this->m_(b, e) ? b : nullptr;
     }
-    const char* operator()(const char* b) const {
+    template<typename It>
+    It operator()(It b) const {
       return this->m_(b) ? b : nullptr;
     }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      auto m = ctx.mark();
+      It p = this->m_(b, e, ctx);
+      ctx.rollback(m);
+      return p ? b : nullptr;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return this->m_(e, end) ? e : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      return true;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
   };
 
   template<typename M>
@@ -443,6 +1237,301 @@ namespace Munchar {
     return Lookahead<M> { m };
   }
 
+  // Right-to-left matching. Every matcher also has a member
+  // `reverse(b, e)` which matches backwards from `e`, never looking before
+  // `b`, and returns the start of the match. Sequences match their right
+  // operand first. `rev(m)` wraps a matcher so that calling it runs the
+  // reverse form, which makes suffix checks cost the length of the suffix.
+  // Lookaheads still look ahead: combinators also have `reverse(b, e, end)`,
+  // which passes down where the input really ends, and a lookahead met
+  // while matching backwards runs its operand forwards from its position up
+  // to `end`, testing the same text it would test in a forward match.
+  // Repetitions are greedy and possessive backwards as they are forwards,
+  // so matching stays linear in the length of the match, but a repetition
+  // must stop at what's to its left on its own: the body of c_comment
+  // swallows the "/*" when matched backwards, while that of
+  // `CHR('/') ^ *(!STR("*/") ^ !STR("/*") ^ _) ^ STR("*/")` stops short
+  // of it, so the rule matches a comment in either direction.
+
+  template<typename M>
+  class Reverse {
+    const M m_;
+  public:
+    constexpr Reverse(const M& m) : m_(m) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return this->m_.reverse(b, e);
+    }
+  };
+
+  template<typename M>
+  constexpr Reverse<M> rev(const M& m) {
+    return Reverse<M> { m };
+  }
+
+
+  // Unanchored search. A Finder computes the set of bytes a match may start
+  // with once, then skips to candidate positions (with memchr when there is
+  // only one such byte) and runs the anchored matcher only there.
+
+  namespace Util {
+
+    // The position type for `C`: a pointer to units of type C, or C itself
+    // when it is already a position (a class such as Rope::Cursor).
+    template<typename C, bool = std::is_class<C>::value>
+    struct Position {
+      typedef const C* type;
+    };
+    template<typename C>
+    struct Position<C, true> {
+      typedef C type;
+    };
+
+  }
+
+  template<typename C = char>
+  struct Basic_Match {
+    typedef typename Util::Position<C>::type Pos;
+    Pos b;
+    Pos e;
+    Basic_Match() : b(nullptr), e(nullptr) { }
+    Basic_Match(Pos beg, Pos end) : b(beg), e(end) { }
+    explicit operator bool() const {
+      return static_cast<bool>(b);
+    }
+    // Keeps `!m` from resolving to the Negation combinator.
+    bool operator!() const {
+      return !b;
+    }
+  };
+
+  typedef Basic_Match<> Match;
+
+  template<typename M>
+  class Finder {
+    const M m_;
+    Byte_Set first_;
+    bool nullable_;
+    int only_;
+    const char* skip(const char* b, const char* e) const {
+      if (only_ >= 0) return static_cast<const char*>(memchr(b, only_, e-b));
+      for (; b < e; ++b) if (first_.has(*b)) return b;
+      return nullptr;
+    }
+    const char* skip(const char* b) const {
+      if (only_ > 0) return strchr(b, only_);
+      for (; *b; ++b) if (first_.has(*b)) return b;
+      return nullptr;
+    }
+    // First-byte sets only describe ASCII exactly for wider input.
+    template<typename C>
+    const C* skip(const C* b, const C* e) const {
+      for (; b < e; ++b) if (Util::unit(*b) > 0x7F || first_.has(Util::unit(*b))) return b;
+      return nullptr;
+    }
+    template<typename C>
+    const C* skip(const C* b) const {
+      for (; *b; ++b) if (Util::unit(*b) > 0x7F || first_.has(Util::unit(*b))) return b;
+      return nullptr;
+    }
+  public:
+    Finder(const M& m) : m_(m), first_(), nullable_(m.first(first_)), only_(-1) {
+      if (!nullable_ && first_.count() == 1) {
+        for (size_t c = 0; c < 256; ++c) if (first_.has(c)) only_ = c;
+      }
+    }
+    template<typename C>
+    Basic_Match<C> operator()(const C* b, const C* e) const {
+      for (const C* p; nullable_ || (b = skip(b, e)); ++b) {
+        if ((p = m_(b, e))) return Basic_Match<C> { b, p };
+        if (!(b < e)) break;
+      }
+      return Basic_Match<C> { };
+    }
+    template<typename C>
+    Basic_Match<C> operator()(const C* b) const {
+      for (const C* p; nullable_ || (b = skip(b)); ++b) {
+        if ((p = m_(b))) return Basic_Match<C> { b, p };
+        if (!*b) break;
+      }
+      return Basic_Match<C> { };
+    }
+  };
+
+  template<typename M>
+  Finder<M> finder(const M& m) {
+    return Finder<M> { m };
+  }
+
+  template<typename M, typename C>
+  Basic_Match<C> find(const M& m, const C* b, const C* e) {
+    return finder(m)(b, e);
+  }
+
+  template<typename M, typename C>
+  Basic_Match<C> find(const M& m, const C* b) {
+    return finder(m)(b);
+  }
+
+  // Calls `f(b, e)` for each non-overlapping match, left to right, and
+  // returns the number of matches.
+
+  template<typename M, typename C, typename F>
+  size_t find_all(const M& m, const C* b, const C* e, F f) {
+    const Finder<M> fm { m };
+    size_t n = 0;
+    for (Basic_Match<C> r; (r = fm(b, e)); ) {
+      f(r.b, r.e);
+      ++n;
+      if (r.e != r.b) b = r.e;
+      else if (r.e != e) b = r.e+1;
+      else break;
+    }
+    return n;
+  }
+
+  template<typename M, typename C, typename F>
+  size_t find_all(const M& m, const C* b, F f) {
+    const Finder<M> fm { m };
+    size_t n = 0;
+    for (Basic_Match<C> r; (r = fm(b)); ) {
+      f(r.b, r.e);
+      ++n;
+      if (r.e != r.b) b = r.e;
+      else if (*r.e) b = r.e+1;
+      else break;
+    }
+    return n;
+  }
+
+
+  // Submatch captures. `cap<I>(m)` records the span matched by `m` in slot
+  // `I` of a Captures context, when matched with `m(b, e, captures)`; the
+  // plain forms ignore it entirely. Slots live in the context itself, and a
+  // mark is simply a copy of them, so backtracking never allocates. `C` is
+  // the unit type of the input, or the position type for input that isn't
+  // an array (`Captures<2, Rope::Cursor>`).
+
+  template<size_t N, typename C = char>
+  class Captures {
+    Basic_Match<C> slots_[N];
+  public:
+    struct Mark {
+      Basic_Match<C> slots[N];
+    };
+    Mark mark() const {
+      Mark m;
+      for (size_t i = 0; i < N; ++i) m.slots[i] = slots_[i];
+      return m;
+    }
+    void rollback(const Mark& m) {
+      for (size_t i = 0; i < N; ++i) slots_[i] = m.slots[i];
+    }
+    template<size_t I>
+    void set(typename Basic_Match<C>::Pos b, typename Basic_Match<C>::Pos e) {
+      static_assert(I < N, "capture slot out of range");
+      slots_[I] = Basic_Match<C> { b, e };
+    }
+    const Basic_Match<C>& operator[](size_t i) const {
+      return slots_[i];
+    }
+    static constexpr size_t size() {
+      return N;
+    }
+  };
+
+  template<size_t I, typename M>
+  class Capture {
+    const M m_;
+  public:
+    constexpr Capture(const M& m) : m_(m) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return this->m_(b, e);
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return this->m_(b);
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      It p = this->m_(b, e, ctx);
+      if (p) ctx.template set<I>(b, p);
+      return p;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return Util::reverse(this->m_, b, e, end);
+    }
+    bool first(Byte_Set& s) const {
+      return this->m_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return this->m_.compile(p);
+    }
+  };
+
+  template<size_t I, typename M>
+  constexpr Capture<I, M> cap(const M& m) {
+    return Capture<I, M> { m };
+  }
+
+
+  // Semantic actions. `m >> f` calls `f(b, e, ctx)` with the span matched by
+  // `m` whenever it succeeds under `m(b, e, ctx)`; the plain forms just match.
+  // The action's type is part of the rule's type, so the call is direct and
+  // can be inlined. Actions run immediately, so a context that accumulates
+  // results should make `mark()`/`rollback()` undo them (e.g. by truncating
+  // a value stack); that way actions run inside an alternative that later
+  // fails leave no trace.
+
+  template<typename M, typename F>
+  class Action {
+    const M m_;
+    const F f_;
+  public:
+    constexpr Action(const M& m, const F& f) : m_(m), f_(f) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return this->m_(b, e);
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return this->m_(b);
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      It p = this->m_(b, e, ctx);
+      if (p) this->f_(b, p, ctx);
+      return p;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return Util::reverse(this->m_, b, e, end);
+    }
+    bool first(Byte_Set& s) const {
+      return this->m_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return this->m_.compile(p);
+    }
+  };
+
+  template<typename M, typename F>
+  constexpr Action<M, F> operator>>(const M& m, const F& f) {
+    return Action<M, F> { m, f };
+  }
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,192 @@
+#ifndef MUNCHAR_BATCH
+#define MUNCHAR_BATCH
+
+#include "munchar.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Munchar {
+
+  // A bounded input range.
+
+  struct Span {
+    const char* b;
+    const char* e;
+    Span() : b(nullptr), e(nullptr) { }
+    Span(const char* beg, const char* end) : b(beg), e(end) { }
+  };
+
+  // Compiler for rules made of single-byte classes, literals, alternations of
+  // single-byte classes, and bounded or unbounded repetition of single-byte
+  // classes. Such a rule is a straight-line program of steps, each consuming
+  // a greedy run of bytes from one class; since PEG repetition never gives
+  // bytes back, the program behaves exactly like the original rule.
+
+  class Byte_Program {
+  public:
+    struct Step {
+      Byte_Set set;
+      size_t lo;
+      size_t hi;
+    };
+    std::vector<Step> steps;
+
+    bool unit() const {
+      return steps.size() == 1 && steps[0].lo == 1 && steps[0].hi == 1;
+    }
+
+    template<typename M>
+    bool bytes(const M& m) {
+      Step s;
+      m.first(s.set);
+      s.lo = s.hi = 1;
+      steps.push_back(s);
+      return true;
+    }
+
+    template<typename M>
+    bool repeat(const M& m, size_t lo, size_t hi) {
+      Byte_Program sub;
+      if (!m.compile(sub) || !sub.unit()) return false;
+      sub.steps[0].lo = lo;
+      sub.steps[0].hi = hi;
+      steps.push_back(sub.steps[0]);
+      return true;
+    }
+
+    template<typename L, typename R>
+    bool alternative(const L& l, const R& r) {
+      Byte_Program lp, rp;
+      if (!l.compile(lp) || !r.compile(rp) || !lp.unit()) return false;
+      if (rp.steps.empty()) {
+        lp.steps[0].lo = 0;
+      }
+      else if (rp.unit()) {
+        for (size_t c = 0; c < 256; ++c) if (rp.steps[0].set.has(c)) lp.steps[0].set.add(c);
+      }
+      else {
+        return false;
+      }
+      steps.push_back(lp.steps[0]);
+      return true;
+    }
+  };
+
+  // Matches one rule against many independent spans. Rules that compile to a
+  // Byte_Program are turned into a DFA once, and each span then costs one
+  // table lookup and one well-predicted branch per byte, with no calls into
+  // the combinator tree. Other rules fall back to calling the matcher per
+  // span. Results are end pointers, or nullptr where the rule failed.
+
+  template<typename M>
+  class Batch {
+    typedef uint16_t State;
+    enum { dead = 0, done = 1, max_states = 4096 };
+
+    const M m_;
+    std::vector<State> delta_;
+    std::vector<State> at_end_;
+
+    // (step, count) pairs are numbered consecutively; counts saturate at
+    // `lo` for unbounded steps.
+    bool build(const Byte_Program& prog) {
+      const std::vector<Byte_Program::Step>& steps = prog.steps;
+      std::vector<size_t> base(steps.size()+1);
+      size_t n = 2;
+      for (size_t i = 0; i < steps.size(); ++i) {
+        base[i] = n;
+        n += (steps[i].hi == size_t(-1) ? steps[i].lo : steps[i].hi) + 1;
+        if (n > max_states) return false;
+      }
+      base[steps.size()] = n;
+      delta_.assign(n*256, dead);
+      at_end_.assign(n, dead);
+      // Filled back to front, so the state a step falls through to on a byte
+      // it doesn't take is already known.
+      for (size_t i = steps.size(); i-- > 0; ) {
+        const Byte_Program::Step& st = steps[i];
+        bool unbounded = st.hi == size_t(-1);
+        size_t top = unbounded ? st.lo : st.hi;
+        for (size_t k = 0; k <= top; ++k) {
+          State s = base[i] + k;
+          State next = k < top ? State(s+1) : (unbounded ? s : State(dead));
+          for (size_t c = 0; c < 256; ++c) {
+            State t;
+            if (st.set.has(c) && next != dead) t = next;
+            else if (k < st.lo) t = dead;
+            else if (i+1 == steps.size()) t = done;
+            else t = delta_[base[i+1]*256 + c];
+            delta_[s*256 + c] = t;
+          }
+          if (k < st.lo) at_end_[s] = dead;
+          else if (i+1 == steps.size()) at_end_[s] = done;
+          else at_end_[s] = at_end_[base[i+1]];
+        }
+      }
+      start_ = steps.empty() ? State(done) : State(base[0]);
+      return true;
+    }
+
+    State start_;
+    bool compiled_;
+
+  public:
+    Batch(const M& m) : m_(m), start_(done), compiled_(false) {
+      Byte_Program prog;
+      compiled_ = m.compile(prog) && build(prog);
+    }
+
+    bool compiled() const {
+      return compiled_;
+    }
+
+    void operator()(const Span* spans, size_t n, const char** results) const {
+      if (!compiled_) {
+        for (size_t i = 0; i < n; ++i) results[i] = m_(spans[i].b, spans[i].e);
+        return;
+      }
+      const State* delta = delta_.data();
+      const State* at_end = at_end_.data();
+      for (size_t i = 0; i < n; ++i) {
+        const char* p = spans[i].b;
+        const char* e = spans[i].e;
+        State s = start_;
+        for (State t; s > done; ++p, s = t) {
+          if (p == e) {
+            s = at_end[s];
+            break;
+          }
+          if ((t = delta[s*256 + static_cast<unsigned char>(*p)]) <= done) {
+            s = t;
+            break;
+          }
+        }
+        results[i] = s == done ? p : nullptr;
+      }
+    }
+
+    void operator()(const std::vector<Span>& spans, std::vector<const char*>& results) const {
+      results.resize(spans.size());
+      (*this)(spans.data(), spans.size(), results.data());
+    }
+  };
+
+  template<typename M>
+  Batch<M> batch(const M& m) {
+    return Batch<M> { m };
+  }
+
+  template<typename M>
+  void match_many(const M& m, const Span* spans, size_t n, const char** results) {
+    batch(m)(spans, n, results);
+  }
+
+  template<typename M>
+  void match_many(const M& m, const std::vector<Span>& spans, std::vector<const char*>& results) {
+    batch(m)(spans, results);
+  }
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef MUNCHAR_CLASSES
+#define MUNCHAR_CLASSES
+
+#include "munchar.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace Munchar {
+
+  // A class of code units for wide input, looked up in a table rather than
+  // scanned like a Char_Class. Units below 0x100 are kept in a Byte_Set, so
+  // the ASCII and Latin-1 members cost one bit test; wider members are kept
+  // as sorted, merged ranges and found by binary search, so a class such as
+  // "CJK ideographs or fullwidth forms" costs a few comparisons however many
+  // units it spans. Built at run time, like a Literal_Set, from ranges of
+  // units or from a NUL-terminated string of them.
+
+  class Unit_Class {
+  public:
+    struct Range {
+      uint32_t lo;
+      uint32_t hi;
+    };
+  private:
+    Byte_Set low_;
+    std::vector<Range> high_;     // sorted, disjoint, all above 0xFF
+
+    void add(uint32_t lo, uint32_t hi) {
+      for (; lo <= hi && lo < 0x100; ++lo) low_.add(lo);
+      if (lo <= hi) high_.push_back(Range { lo, hi });
+    }
+
+    void build() {
+      std::sort(high_.begin(), high_.end(), [](const Range& a, const Range& b) {
+        return a.lo < b.lo;
+      });
+      size_t n = 0;
+      for (auto& r : high_) {
+        if (n && r.lo <= high_[n-1].hi + 1) high_[n-1].hi = std::max(high_[n-1].hi, r.hi);
+        else high_[n++] = r;
+      }
+      high_.resize(n);
+    }
+
+    bool has(uint32_t u) const {
+      if (u < 0x100) return low_.has(u);
+      auto i = std::upper_bound(high_.begin(), high_.end(), u, [](uint32_t u, const Range& r) {
+        return u < r.lo;
+      });
+      return i != high_.begin() && u <= i[-1].hi;
+    }
+
+  public:
+    Unit_Class(std::initializer_list<Range> ranges) : low_(), high_() {
+      for (auto& r : ranges) add(r.lo, r.hi);
+      build();
+    }
+
+    template<typename C>
+    explicit Unit_Class(const C* s) : low_(), high_() {
+      for (; *s; ++s) add(Util::unit(*s), Util::unit(*s));
+      build();
+    }
+
+    template<typename It>
+    It operator()(It b, It e) const {
+      return (b < e) && has(Util::unit(*b)) ? b+1 : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return *b && has(Util::unit(*b)) ? b+1 : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return (b < e) && has(Util::unit(e[-1])) ? e-1 : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      for (size_t c = 0; c < 0x100; ++c) if (low_.has(c)) s.add(c);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return p.bytes(*this);
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef MUNCHAR_COMPRESSED
+#define MUNCHAR_COMPRESSED
+
+#include "munchar_lexer.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef MUNCHAR_ZSTD
+#include <zstd.h>
+#endif
+
+namespace Munchar {
+
+  // Lexing compressed input without decompressing it first. A
+  // Decompressing_Reader produces the decompressed bytes of a file
+  // descriptor or an in-memory buffer a window at a time; gzip data (link
+  // with -lz) and, when MUNCHAR_ZSTD is defined, zstd data (link with
+  // -lzstd) are recognized by their magic numbers, and anything else is
+  // passed through unchanged. Concatenated gzip members and zstd frames are
+  // read as one stream. `lex_stream` feeds the windows to a Stream_Lexer, so
+  // memory stays bounded by the compressed input buffer, the window and the
+  // longest unfinished token, whatever the decompressed size.
+
+  class Decompressing_Reader {
+  public:
+    enum Format { plain, gzip, zstd };
+  private:
+    int fd_;
+    std::unique_ptr<unsigned char[]> in_buf_;
+    size_t in_size_;
+    const unsigned char* in_p_;
+    const unsigned char* in_e_;
+    bool in_eof_;
+    Format format_;
+    bool done_;
+    const char* error_;
+    z_stream zs_;
+#ifdef MUNCHAR_ZSTD
+    ZSTD_DCtx* zd_;
+#endif
+
+    // Reads more compressed input once what's buffered is used up.
+    bool refill() {
+      if (in_p_ < in_e_) return true;
+      if (in_eof_) return false;
+      if (fd_ < 0) {
+        in_eof_ = true;
+        return false;
+      }
+      for (;;) {
+        ssize_t r = ::read(fd_, in_buf_.get(), in_size_);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) error_ = strerror(errno);
+        if (r <= 0) {
+          in_eof_ = true;
+          return false;
+        }
+        in_p_ = in_buf_.get();
+        in_e_ = in_p_ + r;
+        return true;
+      }
+    }
+
+    // Buffers at least `n` bytes, if there are that many, without consuming
+    // them.
+    void peek(size_t n) {
+      if (fd_ < 0) return;
+      size_t have = in_e_ - in_p_;
+      memmove(in_buf_.get(), in_p_, have);
+      while (have < n && !in_eof_) {
+        ssize_t r = ::read(fd_, in_buf_.get() + have, in_size_ - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) error_ = strerror(errno);
+        if (r <= 0) in_eof_ = true;
+        else have += r;
+      }
+      in_p_ = in_buf_.get();
+      in_e_ = in_p_ + have;
+    }
+
+    void detect() {
+      peek(4);
+      size_t n = in_e_ - in_p_;
+      if (n >= 2 && in_p_[0] == 0x1F && in_p_[1] == 0x8B) format_ = gzip;
+      else if (n >= 4 && in_p_[0] == 0x28 && in_p_[1] == 0xB5 && in_p_[2] == 0x2F && in_p_[3] == 0xFD) format_ = zstd;
+      if (format_ == gzip) {
+        memset(std::addressof(zs_), 0, sizeof zs_);
+        // 15 window bits, +16 for the gzip wrapper.
+        if (inflateInit2(std::addressof(zs_), 15 + 16) != Z_OK) error_ = "cannot initialize zlib";
+      }
+      if (format_ == zstd) {
+#ifdef MUNCHAR_ZSTD
+        zd_ = ZSTD_createDCtx();
+        if (!zd_) error_ = "cannot initialize zstd";
+#else
+        error_ = "zstd input, but zstd support isn't compiled in";
+#endif
+      }
+    }
+
+    ssize_t read_plain(char* out, size_t n) {
+      size_t k = 0;
+      while (k < n && refill()) {
+        size_t m = in_e_ - in_p_ < ptrdiff_t(n - k) ? in_e_ - in_p_ : n - k;
+        memcpy(out + k, in_p_, m);
+        in_p_ += m;
+        k += m;
+      }
+      return k;
+    }
+
+    ssize_t read_gzip(char* out, size_t n) {
+      zs_.next_out = reinterpret_cast<Bytef*>(out);
+      zs_.avail_out = n;
+      while (zs_.avail_out) {
+        if (!refill()) {
+          if (!error_) error_ = "truncated compressed data";
+          return -1;
+        }
+        zs_.next_in = const_cast<Bytef*>(in_p_);
+        zs_.avail_in = in_e_ - in_p_;
+        int r = inflate(std::addressof(zs_), Z_NO_FLUSH);
+        in_p_ = zs_.next_in;
+        if (r == Z_STREAM_END) {
+          // Another member may follow.
+          if (!refill()) {
+            done_ = true;
+            break;
+          }
+          inflateReset(std::addressof(zs_));
+        }
+        else if (r != Z_OK && r != Z_BUF_ERROR) {
+          error_ = zs_.msg ? zs_.msg : "corrupt compressed data";
+          return -1;
+        }
+      }
+      return n - zs_.avail_out;
+    }
+
+#ifdef MUNCHAR_ZSTD
+    ssize_t read_zstd(char* out, size_t n) {
+      ZSTD_outBuffer o = { out, n, 0 };
+      size_t r = 0;
+      while (o.pos < o.size) {
+        if (!refill()) {
+          if (r || error_) {
+            if (!error_) error_ = "truncated compressed data";
+            return -1;
+          }
+          done_ = true;
+          break;
+        }
+        ZSTD_inBuffer i = { in_p_, size_t(in_e_ - in_p_), 0 };
+        r = ZSTD_decompressStream(zd_, std::addressof(o), std::addressof(i));
+        in_p_ += i.pos;
+        if (ZSTD_isError(r)) {
+          error_ = ZSTD_getErrorName(r);
+          return -1;
+        }
+      }
+      return o.pos;
+    }
+#endif
+
+    void init() {
+      format_ = plain;
+      done_ = false;
+      error_ = nullptr;
+#ifdef MUNCHAR_ZSTD
+      zd_ = nullptr;
+#endif
+      detect();
+    }
+
+  public:
+    // Reads from `fd`, `in_size` compressed bytes at a time. The descriptor
+    // isn't closed.
+    explicit Decompressing_Reader(int fd, size_t in_size = 64*1024)
+    : fd_(fd), in_buf_(new unsigned char[in_size < 4 ? 4 : in_size]), in_size_(in_size < 4 ? 4 : in_size),
+      in_p_(nullptr), in_e_(nullptr), in_eof_(false) {
+      init();
+    }
+
+    // Reads from memory, in place.
+    Decompressing_Reader(const char* b, const char* e)
+    : fd_(-1), in_buf_(), in_size_(0), in_p_(reinterpret_cast<const unsigned char*>(b)),
+      in_e_(reinterpret_cast<const unsigned char*>(e)), in_eof_(false) {
+      init();
+    }
+
+    Decompressing_Reader(const Decompressing_Reader&) = delete;
+    Decompressing_Reader& operator=(const Decompressing_Reader&) = delete;
+
+    ~Decompressing_Reader() {
+      if (format_ == gzip) inflateEnd(std::addressof(zs_));
+#ifdef MUNCHAR_ZSTD
+      if (zd_) ZSTD_freeDCtx(zd_);
+#endif
+    }
+
+    // Writes up to `n` decompressed bytes to `out`, stopping short only at
+    // the end of the data; returns how many, or -1 on an error.
+    ssize_t read(char* out, size_t n) {
+      if (error_) return -1;
+      if (done_) return 0;
+      ssize_t r = -1;
+      switch (format_) {
+        case plain: r = read_plain(out, n); break;
+        case gzip:  r = read_gzip(out, n); break;
+#ifdef MUNCHAR_ZSTD
+        case zstd:  r = read_zstd(out, n); break;
+#else
+        case zstd:  break;
+#endif
+      }
+      return error_ ? -1 : r;
+    }
+
+    Format format() const {
+      return format_;
+    }
+
+    // What went wrong, or nullptr.
+    const char* error() const {
+      return error_;
+    }
+  };
+
+  // Lexes everything `in` produces through `lexer`, `window` bytes at a time,
+  // and finishes the stream. A read error is reported as a lexing error;
+  // `in.error()` tells the two apart.
+  template<typename R, typename S, typename F>
+  typename Stream_Lexer<S>::Status lex_stream(R& in, Stream_Lexer<S>& lexer, F emit, size_t window = 64*1024) {
+    std::unique_ptr<char[]> buf(new char[window]);
+    for (;;) {
+      ssize_t n = in.read(buf.get(), window);
+      if (n < 0) return Stream_Lexer<S>::error;
+      if (!n) return lexer.finish(emit);
+      if (lexer.feed(buf.get(), buf.get() + n, emit) == Stream_Lexer<S>::error) return Stream_Lexer<S>::error;
+    }
+  }
+
+}
+
+#endif
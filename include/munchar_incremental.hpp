@@ -0,0 +1,193 @@
+#ifndef MUNCHAR_INCREMENTAL
+#define MUNCHAR_INCREMENTAL
+
+#include "munchar_lexer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace Munchar {
+
+  // Incremental lexing for editors. An Incremental_Lexer keeps the tokens of
+  // a document (the scanner is the same as a Stream_Lexer's, a template on
+  // the position) and, after an edit, relexes only what the edit can have
+  // changed. While scanning, positions are passed as Util::Reach, which
+  // records the furthest byte each token's scan looked at (lookahead
+  // included), so relexing restarts at the first token whose scan saw the
+  // edited bytes. It stops as soon as it reaches, past the inserted text,
+  // the start of an old token with the same kind and length (at its offset
+  // shifted by the edit's size change): a scanner's result depends only on
+  // the bytes it reads, so every later token is unchanged. The token buffer
+  // is patched in place; the tokens after the edit are only moved and have
+  // their offsets shifted, without being scanned again.
+
+  namespace Util {
+
+    // A byte pointer that records, in a location shared by all positions of
+    // a scan, one past the furthest byte read; a failed comparison against
+    // the end counts as reading one past it, since the result depends on
+    // where the input ends.
+    class Reach : public Watched_Pointer<Reach> {
+      friend class Watched_Pointer<Reach>;
+      const char** far_;
+      void read(const char* q) const {
+        if (far_ && *far_ < q) *far_ = q;
+      }
+      void ended(const Reach& q) const {
+        (far_ ? *this : q).read(q.p_+1);
+      }
+      void moved() { }
+    public:
+      Reach() : Reach(nullptr) { }
+      Reach(std::nullptr_t) : Watched_Pointer(nullptr), far_(nullptr) { }
+      Reach(const char* p, const char** far) : Watched_Pointer(p), far_(far) { }
+    };
+
+  }
+
+  // Replacing `removed` bytes at `offset` with `inserted` bytes.
+  struct Edit {
+    size_t offset;
+    size_t removed;
+    size_t inserted;
+  };
+
+  template<typename S>
+  class Incremental_Lexer {
+    const S scan_;
+    std::vector<Token> tokens_;
+    std::vector<size_t> look_;    // bytes looked at past each token's end
+    size_t max_look_;
+    size_t stop_;
+    size_t first_;
+    size_t replaced_;
+    size_t inserted_;
+    size_t relexed_;
+
+    // Scans the token at `p`, setting its kind and how far past its end the
+    // scan looked.
+    const char* scan(const char* p, const char* e, int& kind, size_t& look) const {
+      const char* far = p;
+      const char* q = this->scan_(Util::Reach { p, &far }, Util::Reach { e, &far }, kind).ptr();
+      look = q && far > q ? far - q : 0;
+      return q;
+    }
+
+    size_t end(size_t k) const {
+      return tokens_[k].offset + tokens_[k].length;
+    }
+
+  public:
+    Incremental_Lexer(const S& scan)
+    : scan_(scan), tokens_(), look_(), max_look_(0), stop_(0), first_(0), replaced_(0), inserted_(0), relexed_(0) { }
+
+    // Lexes a whole document, replacing any previous tokens.
+    bool lex(const char* b, const char* e) {
+      tokens_.clear();
+      look_.clear();
+      max_look_ = 0;
+      return edit(b, e, Edit { 0, 0, size_t(e-b) });
+    }
+
+    // Updates the tokens for `edit`, given the document [b, e) after it.
+    // Returns whether the whole document lexes.
+    bool edit(const char* b, const char* e, const Edit& edit) {
+      size_t o = edit.offset;
+      ptrdiff_t delta = ptrdiff_t(edit.inserted) - ptrdiff_t(edit.removed);
+      // The first token whose scan looked at the edited bytes.
+      size_t k0 = std::partition_point(tokens_.begin(), tokens_.end(), [&](const Token& t) {
+        return t.offset + t.length <= o;
+      }) - tokens_.begin();
+      for (size_t k = k0; k-- > 0 && end(k) + max_look_ > o; ) {
+        if (end(k) + look_[k] > o) k0 = k;
+      }
+      size_t start = k0 < tokens_.size() ? tokens_[k0].offset : std::min(stop_, o);
+
+      std::vector<Token> fresh;
+      std::vector<size_t> fresh_look;
+      size_t j = k0;
+      bool synced = false;
+      const char* p = b + start;
+      while (p < e) {
+        int kind;
+        size_t look;
+        const char* q = scan(p, e, kind, look);
+        if (!q || q == p) break;
+        size_t at = p-b;
+        if (at >= o + edit.inserted) {
+          size_t old_at = at - delta;
+          while (j < tokens_.size() && tokens_[j].offset < old_at) ++j;
+          if (j < tokens_.size() && tokens_[j].offset == old_at &&
+              tokens_[j].kind == kind && tokens_[j].length == size_t(q-p)) {
+            synced = true;
+            break;
+          }
+        }
+        fresh.push_back(Token { kind, at, size_t(q-p) });
+        fresh_look.push_back(look);
+        max_look_ = std::max(max_look_, look);
+        p = q;
+      }
+      relexed_ = (p - b) - start;
+
+      size_t old_end = synced ? j : tokens_.size();
+      first_ = k0;
+      replaced_ = old_end - k0;
+      inserted_ = fresh.size();
+      size_t common = std::min(replaced_, fresh.size());
+      std::copy(fresh.begin(), fresh.begin() + common, tokens_.begin() + k0);
+      std::copy(fresh_look.begin(), fresh_look.begin() + common, look_.begin() + k0);
+      if (fresh.size() > common) {
+        tokens_.insert(tokens_.begin() + k0 + common, fresh.begin() + common, fresh.end());
+        look_.insert(look_.begin() + k0 + common, fresh_look.begin() + common, fresh_look.end());
+      }
+      else {
+        tokens_.erase(tokens_.begin() + k0 + common, tokens_.begin() + old_end);
+        look_.erase(look_.begin() + k0 + common, look_.begin() + old_end);
+      }
+      if (synced) {
+        for (size_t k = k0 + fresh.size(); k < tokens_.size(); ++k) tokens_[k].offset += delta;
+        stop_ += delta;
+      }
+      else {
+        stop_ = p-b;
+      }
+      return stop_ == size_t(e-b);
+    }
+
+    const std::vector<Token>& tokens() const {
+      return tokens_;
+    }
+
+    // Where lexing stops: the document's size, or where the bad token
+    // starts.
+    size_t offset() const {
+      return stop_;
+    }
+
+    // The last edit replaced the `replaced()` tokens at index `first()` with
+    // `inserted()` new ones.
+    size_t first() const {
+      return first_;
+    }
+    size_t replaced() const {
+      return replaced_;
+    }
+    size_t inserted() const {
+      return inserted_;
+    }
+
+    // How many bytes the last edit or lex scanned.
+    size_t relexed() const {
+      return relexed_;
+    }
+  };
+
+  template<typename S>
+  Incremental_Lexer<S> incremental_lexer(const S& scan) {
+    return Incremental_Lexer<S> { scan };
+  }
+
+}
+
+#endif
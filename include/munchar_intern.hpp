@@ -0,0 +1,356 @@
+#ifndef MUNCHAR_INTERN
+#define MUNCHAR_INTERN
+
+#include "munchar.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Munchar {
+
+  // Symbol interning. A symbol table maps each distinct byte string to a
+  // dense 32-bit id (0, 1, 2, ... in order of first appearance), so that
+  // identifiers can be compared and hashed downstream as integers. Strings
+  // are copied into an arena owned by the table; the ranges returned for an
+  // id stay valid for the table's lifetime.
+
+  namespace Util {
+
+    // Word-at-a-time multiplicative hash. Not for hostile input.
+    inline uint64_t hash_bytes(const char* p, size_t n) {
+      uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+      for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+      }
+      if (n) {
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * 0xC4CEB9FE1A85EC53ull;
+      }
+      return h ^ (h >> 29);
+    }
+
+    // Bump allocator for interned strings; never frees individual strings.
+    class Arena {
+      static const size_t block_size = 64*1024;
+      std::vector<std::unique_ptr<char[]>> blocks_;
+      char* p_;
+      size_t left_;
+    public:
+      Arena() : p_(nullptr), left_(0) { }
+      const char* copy(const char* s, size_t n) {
+        if (n > left_) {
+          size_t size = n > block_size/4 ? n : block_size;
+          blocks_.emplace_back(new char[size]);
+          if (size == n) {
+            memcpy(blocks_.back().get(), s, n);
+            return blocks_.back().get();
+          }
+          p_ = blocks_.back().get();
+          left_ = size;
+        }
+        char* r = p_;
+        memcpy(r, s, n);
+        p_ += n;
+        left_ -= n;
+        return r;
+      }
+    };
+
+    struct Symbol {
+      const char* s;
+      uint32_t len;
+      uint32_t hash;
+    };
+
+    // Open-addressing index from strings to ids, with linear probing and a
+    // load factor of at most one half. Slots hold id+1, so 0 is empty; the
+    // low 32 bits of the hash are stored with each symbol to reject most
+    // mismatches without touching the string.
+    class Symbol_Index {
+      std::vector<uint32_t> slots_;
+      size_t count_;
+
+      template<typename Symbols>
+      void grow(const Symbols& syms) {
+        std::vector<uint32_t> old(slots_.size() ? slots_.size()*2 : 64, 0);
+        old.swap(slots_);
+        size_t mask = slots_.size()-1;
+        for (uint32_t s : old) {
+          if (!s) continue;
+          size_t i = syms[s-1].hash & mask;
+          while (slots_[i]) i = (i+1) & mask;
+          slots_[i] = s;
+        }
+      }
+
+    public:
+      static const uint32_t none = uint32_t(-1);
+
+      Symbol_Index() : count_(0) { }
+
+      // The slot where the string is, or where it would go.
+      template<typename Symbols>
+      uint32_t* probe(const Symbols& syms, const char* b, size_t n, uint32_t h) {
+        if (slots_.empty()) return nullptr;
+        size_t mask = slots_.size()-1;
+        for (size_t i = h & mask; ; i = (i+1) & mask) {
+          uint32_t s = slots_[i];
+          if (!s) return &slots_[i];
+          const Symbol& sym = syms[s-1];
+          if (sym.hash == h && sym.len == n && !memcmp(sym.s, b, n)) return &slots_[i];
+        }
+      }
+
+      template<typename Symbols>
+      uint32_t find(const Symbols& syms, const char* b, size_t n, uint32_t h) const {
+        uint32_t* slot = const_cast<Symbol_Index*>(this)->probe(syms, b, n, h);
+        return slot && *slot ? *slot-1 : none;
+      }
+
+      // Makes room for one more id, then returns the empty slot for the
+      // string (or its existing slot).
+      template<typename Symbols>
+      uint32_t* reserve(const Symbols& syms, const char* b, size_t n, uint32_t h) {
+        if ((count_+1)*2 > slots_.size()) grow(syms);
+        return probe(syms, b, n, h);
+      }
+
+      void insert(uint32_t* slot, uint32_t id) {
+        *slot = id+1;
+        ++count_;
+      }
+    };
+
+  }
+
+  class Symbol_Table {
+    Util::Arena arena_;
+    std::vector<Util::Symbol> syms_;
+    Util::Symbol_Index index_;
+  public:
+    static const uint32_t none = Util::Symbol_Index::none;
+
+    uint32_t intern(const char* b, const char* e, uint64_t hash) {
+      size_t n = e-b;
+      uint32_t h = uint32_t(hash);
+      uint32_t* slot = index_.reserve(syms_, b, n, h);
+      if (*slot) return *slot-1;
+      uint32_t id = syms_.size();
+      syms_.push_back(Util::Symbol { arena_.copy(b, n), uint32_t(n), h });
+      index_.insert(slot, id);
+      return id;
+    }
+
+    uint32_t intern(const char* b, const char* e) {
+      return intern(b, e, Util::hash_bytes(b, e-b));
+    }
+
+    uint32_t intern(const char* s) {
+      return intern(s, s+strlen(s));
+    }
+
+    // The id of a string that was already interned, or `none`.
+    uint32_t find(const char* b, const char* e) const {
+      return index_.find(syms_, b, e-b, uint32_t(Util::hash_bytes(b, e-b)));
+    }
+
+    Match operator[](uint32_t id) const {
+      return Match { syms_[id].s, syms_[id].s + syms_[id].len };
+    }
+
+    size_t size() const {
+      return syms_.size();
+    }
+  };
+
+  // A symbol table shared by several threads. Strings are distributed over
+  // independently locked shards by hash, so threads interning different
+  // strings rarely contend; ids still come from one counter and stay dense.
+  // Looking up the string for an id takes no lock: symbols live in segments
+  // of doubling size that never move once allocated.
+
+  class Concurrent_Symbol_Table {
+    static const size_t shard_count = 64;
+    static const size_t first_segment = 1024;
+    static const size_t segment_count = 23;
+
+    struct Shard {
+      std::mutex lock;
+      Util::Arena arena;
+      Util::Symbol_Index index;
+    };
+
+    // Indexable view of the segments, for Symbol_Index.
+    struct Symbols {
+      const Concurrent_Symbol_Table& t;
+      const Util::Symbol& operator[](size_t id) const {
+        return t.symbol(id);
+      }
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<Util::Symbol*> segments_[segment_count];
+    std::atomic<uint32_t> next_;
+
+    static size_t segment(size_t id, size_t& offset) {
+      size_t k = 0;
+      size_t q = id / first_segment + 1;
+      while (q >>= 1) ++k;
+      offset = id - first_segment * ((size_t(1) << k) - 1);
+      return k;
+    }
+
+    const Util::Symbol& symbol(size_t id) const {
+      size_t off;
+      size_t k = segment(id, off);
+      return segments_[k].load(std::memory_order_acquire)[off];
+    }
+
+    Util::Symbol& slot(size_t id) {
+      size_t off;
+      size_t k = segment(id, off);
+      Util::Symbol* seg = segments_[k].load(std::memory_order_acquire);
+      if (!seg) {
+        Util::Symbol* fresh = new Util::Symbol[first_segment << k];
+        if (segments_[k].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel)) seg = fresh;
+        else delete[] fresh;
+      }
+      return seg[off];
+    }
+
+  public:
+    static const uint32_t none = Util::Symbol_Index::none;
+
+    Concurrent_Symbol_Table() : shards_(new Shard[shard_count]), next_(0) {
+      for (auto& s : segments_) s.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~Concurrent_Symbol_Table() {
+      for (auto& s : segments_) delete[] s.load(std::memory_order_relaxed);
+    }
+
+    Concurrent_Symbol_Table(const Concurrent_Symbol_Table&) = delete;
+    Concurrent_Symbol_Table& operator=(const Concurrent_Symbol_Table&) = delete;
+
+    uint32_t intern(const char* b, const char* e, uint64_t hash) {
+      size_t n = e-b;
+      uint32_t h = uint32_t(hash);
+      Shard& sh = shards_[(hash >> 58) % shard_count];
+      std::lock_guard<std::mutex> guard(sh.lock);
+      Symbols syms = { *this };
+      uint32_t* s = sh.index.reserve(syms, b, n, h);
+      if (*s) return *s-1;
+      uint32_t id = next_.fetch_add(1, std::memory_order_relaxed);
+      slot(id) = Util::Symbol { sh.arena.copy(b, n), uint32_t(n), h };
+      sh.index.insert(s, id);
+      return id;
+    }
+
+    uint32_t intern(const char* b, const char* e) {
+      return intern(b, e, Util::hash_bytes(b, e-b));
+    }
+
+    uint32_t intern(const char* s) {
+      return intern(s, s+strlen(s));
+    }
+
+    uint32_t find(const char* b, const char* e) const {
+      uint64_t hash = Util::hash_bytes(b, e-b);
+      Shard& sh = shards_[(hash >> 58) % shard_count];
+      std::lock_guard<std::mutex> guard(sh.lock);
+      Symbols syms = { *this };
+      return sh.index.find(syms, b, e-b, uint32_t(hash));
+    }
+
+    // Only valid for ids this thread has obtained from the table (or
+    // received from a thread that did, with the usual synchronization).
+    Match operator[](uint32_t id) const {
+      const Util::Symbol& s = symbol(id);
+      return Match { s.s, s.s + s.len };
+    }
+
+    size_t size() const {
+      return next_.load(std::memory_order_acquire);
+    }
+  };
+
+  // Interning sink. `intern(m, table)` matches like `m`; matched through a
+  // context, it interns the matched bytes (hashing them while they're still
+  // in cache) and reports the id with `ctx.symbol(id, b, e)`. Tables take
+  // contiguous bytes, so a match over other positions (a Rope::Cursor) is
+  // copied out first.
+
+  namespace Util {
+
+    template<typename T>
+    uint32_t intern(T& t, const char* b, const char* e) {
+      return t.intern(b, e);
+    }
+
+    template<typename T, typename It>
+    uint32_t intern(T& t, It b, It e) {
+      static_assert(std::is_same<typename std::decay<decltype(*b)>::type, char>::value,
+                    "symbol tables intern bytes");
+      std::string s;
+      s.reserve(e-b);
+      for (; b < e; ++b) s += *b;
+      return t.intern(s.data(), s.data() + s.size());
+    }
+
+  }
+
+  template<typename M, typename T>
+  class Interned {
+    const M m_;
+    T* t_;
+  public:
+    constexpr Interned(const M& m, T* t) : m_(m), t_(t) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return this->m_(b, e);
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return this->m_(b);
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      It p = this->m_(b, e, ctx);
+      if (p) ctx.symbol(Util::intern(*this->t_, b, p), b, p);
+      return p;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return Util::reverse(this->m_, b, e, end);
+    }
+    bool first(Byte_Set& s) const {
+      return this->m_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return this->m_.compile(p);
+    }
+  };
+
+  template<typename M, typename T>
+  constexpr Interned<M, T> intern(const M& m, T& table) {
+    return Interned<M, T> { m, std::addressof(table) };
+  }
+
+}
+
+#endif
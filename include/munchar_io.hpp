@@ -0,0 +1,177 @@
+#ifndef MUNCHAR_IO
+#define MUNCHAR_IO
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Munchar {
+
+  // Input loading (POSIX). An Input_Buffer holds a whole input followed by
+  // at least `padding` readable zero bytes, so both the NUL-terminated forms
+  // and matchers that read a few bytes past a bounded range (word-at-a-time
+  // comparisons) can run on it directly. Regular files are memory-mapped
+  // read-only with sequential read-ahead requested, so nothing is copied:
+  // the kernel already zero-fills the unused part of a file's last page, and
+  // when that is shorter than the padding (a file that ends on or near a page
+  // boundary), the file is mapped into a reserved region whose next page is
+  // anonymous and therefore zero. Anything that can't be mapped (pipes,
+  // terminals, files in /proc) is read into a padded heap buffer instead.
+
+  class Input_Buffer {
+    char* base_;
+    size_t length_;     // bytes mapped, or 0 for a heap buffer
+    size_t size_;
+    int error_;
+
+    static size_t round_up(size_t n, size_t page) {
+      return (n + page-1) / page * page;
+    }
+
+    void release() {
+      if (length_) munmap(base_, length_);
+      else free(base_);
+      base_ = nullptr;
+      length_ = size_ = 0;
+    }
+
+    bool map(int fd, size_t n, size_t padding) {
+      size_t page = sysconf(_SC_PAGESIZE);
+      size_t file_len = round_up(n, page);
+      size_t total = file_len - n >= padding ? file_len : round_up(n + padding, page);
+      void* p;
+      if (total == file_len) {
+        p = mmap(nullptr, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      else {
+        p = mmap(nullptr, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED && mmap(p, file_len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+          munmap(p, total);
+          p = MAP_FAILED;
+        }
+      }
+      if (p == MAP_FAILED) return false;
+      madvise(p, file_len, MADV_SEQUENTIAL);
+      base_ = static_cast<char*>(p);
+      length_ = total;
+      size_ = n;
+      return true;
+    }
+
+    bool read_all(int fd, size_t padding) {
+      for (size_t cap = 0; ; ) {
+        if (size_ == cap) {
+          cap = cap ? cap*2 : 64*1024;
+          char* p = static_cast<char*>(realloc(base_, cap + padding));
+          if (!p) {
+            error_ = ENOMEM;
+            return false;
+          }
+          base_ = p;
+        }
+        ssize_t r = ::read(fd, base_ + size_, cap - size_);
+        if (r < 0) {
+          if (errno == EINTR) continue;
+          error_ = errno;
+          return false;
+        }
+        if (!r) break;
+        size_ += r;
+      }
+      memset(base_ + size_, 0, padding);
+      return true;
+    }
+
+  public:
+    static const size_t default_padding = 64;
+
+    Input_Buffer() : base_(nullptr), length_(0), size_(0), error_(0) { }
+
+    // Loads everything from `fd`, from its current position when it has to
+    // be read. The descriptor isn't closed.
+    Input_Buffer(int fd, size_t padding) : Input_Buffer() {
+      struct stat st;
+      if (fstat(fd, std::addressof(st)) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && map(fd, st.st_size, padding)) return;
+      if (!read_all(fd, padding)) release();
+    }
+
+    Input_Buffer(Input_Buffer&& b)
+    : base_(b.base_), length_(b.length_), size_(b.size_), error_(b.error_) {
+      b.base_ = nullptr;
+      b.length_ = b.size_ = 0;
+    }
+
+    Input_Buffer& operator=(Input_Buffer&& b) {
+      if (this != std::addressof(b)) {
+        release();
+        base_ = b.base_;
+        length_ = b.length_;
+        size_ = b.size_;
+        error_ = b.error_;
+        b.base_ = nullptr;
+        b.length_ = b.size_ = 0;
+      }
+      return *this;
+    }
+
+    Input_Buffer(const Input_Buffer&) = delete;
+    Input_Buffer& operator=(const Input_Buffer&) = delete;
+
+    ~Input_Buffer() {
+      release();
+    }
+
+    // Whether the input was loaded; otherwise `error()` is the errno value.
+    bool ok() const {
+      return !error_;
+    }
+    int error() const {
+      return error_;
+    }
+
+    const char* data() const {
+      return base_;
+    }
+    const char* begin() const {
+      return base_;
+    }
+    const char* end() const {
+      return base_ + size_;
+    }
+    size_t size() const {
+      return size_;
+    }
+
+    // Whether the input is mapped rather than copied.
+    bool mapped() const {
+      return length_;
+    }
+
+    friend Input_Buffer load_file(const char* path, size_t padding);
+  };
+
+  inline Input_Buffer load_fd(int fd, size_t padding = Input_Buffer::default_padding) {
+    return Input_Buffer { fd, padding };
+  }
+
+  inline Input_Buffer load_file(const char* path, size_t padding = Input_Buffer::default_padding) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      Input_Buffer b;
+      b.error_ = errno;
+      return b;
+    }
+    Input_Buffer b { fd, padding };
+    close(fd);
+    return b;
+  }
+
+}
+
+#endif
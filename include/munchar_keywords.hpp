@@ -0,0 +1,199 @@
+#ifndef MUNCHAR_KEYWORDS
+#define MUNCHAR_KEYWORDS
+
+#include "munchar.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace Munchar {
+
+  // Keyword classification. Rather than trying one keyword matcher after
+  // another, a scanner matches an identifier once and looks it up in a
+  // Keyword_Table. The table is a perfect hash built from the keyword list
+  // (hash and displace: the hash picks a bucket, the bucket's displacement
+  // picks a slot that no other keyword uses), so a lookup is one hash of the
+  // identifier, two table reads and one compare of the first sixteen bytes,
+  // whatever the number of keywords.
+
+  struct Keyword {
+    const char* word;
+    int kind;
+  };
+
+  class Keyword_Table {
+  public:
+    static const int none = -1;
+  private:
+    struct Slot {
+      uint64_t lo;
+      uint64_t hi;
+      size_t len;
+      int kind;
+      size_t rest;       // index into rest_ of bytes past the sixteenth
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<uint16_t> disp_;
+    std::string rest_;
+    uint64_t seed_;
+    size_t slot_bits_;
+    size_t bucket_bits_;
+
+    static void head(const char* b, size_t n, uint64_t& lo, uint64_t& hi) {
+      lo = hi = 0;
+      memcpy(&lo, b, n < 8 ? n : 8);
+      if (n > 8) memcpy(&hi, b+8, n < 16 ? n-8 : 8);
+    }
+
+    static uint64_t mix(uint64_t h) {
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDull;
+      h ^= h >> 33;
+      return h;
+    }
+
+    uint64_t hash(const char* b, size_t n, uint64_t lo, uint64_t hi) const {
+      uint64_t h = (seed_ ^ lo ^ n) * 0x9E3779B97F4A7C15ull;
+      h = (h ^ (h >> 32) ^ hi) * 0xC4CEB9FE1A85EC53ull;
+      for (size_t i = 16; i < n; ++i) h = (h ^ static_cast<unsigned char>(b[i])) * 0x100000001B3ull;
+      return h ^ (h >> 29);
+    }
+
+    size_t bucket(uint64_t h) const {
+      return bucket_bits_ ? h >> (64 - bucket_bits_) : 0;
+    }
+
+    size_t slot(uint64_t h, uint16_t d) const {
+      return slot_bits_ ? ((h + d * 0x9E3779B97F4A7C15ull) * 0xFF51AFD7ED558CCDull) >> (64 - slot_bits_) : 0;
+    }
+
+    bool place(const std::vector<Keyword>& kws) {
+      size_t n = kws.size();
+      std::vector<uint64_t> hs(n);
+      std::vector<std::vector<size_t>> buckets(size_t(1) << bucket_bits_);
+      for (size_t i = 0; i < n; ++i) {
+        uint64_t lo, hi;
+        size_t len = strlen(kws[i].word);
+        head(kws[i].word, len, lo, hi);
+        hs[i] = hash(kws[i].word, len, lo, hi);
+        buckets[bucket(hs[i])].push_back(i);
+      }
+      std::vector<size_t> order(buckets.size());
+      for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+      std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+      });
+      std::vector<bool> taken(size_t(1) << slot_bits_, false);
+      disp_.assign(buckets.size(), 0);
+      for (size_t bk : order) {
+        const std::vector<size_t>& keys = buckets[bk];
+        if (keys.empty()) break;
+        size_t d = 0;
+        for (; d <= 0xFFFF; ++d) {
+          std::vector<size_t> used;
+          for (size_t k : keys) {
+            size_t s = slot(hs[k], d);
+            if (taken[s] || std::find(used.begin(), used.end(), s) != used.end()) break;
+            used.push_back(s);
+          }
+          if (used.size() == keys.size()) break;
+        }
+        if (d > 0xFFFF) return false;
+        disp_[bk] = d;
+        for (size_t k : keys) taken[slot(hs[k], d)] = true;
+      }
+      slots_.assign(taken.size(), Slot { 0, 0, 0, none, 0 });
+      rest_.clear();
+      for (size_t i = 0; i < n; ++i) {
+        Slot& s = slots_[slot(hs[i], disp_[bucket(hs[i])])];
+        s.len = strlen(kws[i].word);
+        s.kind = kws[i].kind;
+        head(kws[i].word, s.len, s.lo, s.hi);
+        s.rest = rest_.size();
+        if (s.len > 16) rest_.append(kws[i].word + 16, s.len - 16);
+      }
+      return true;
+    }
+
+    void build(std::vector<Keyword> kws) {
+      // Empty and repeated keywords can't be placed; the first of a repeated
+      // keyword wins.
+      std::vector<Keyword> uniq;
+      for (auto& k : kws) {
+        if (!*k.word) continue;
+        bool seen = false;
+        for (auto& u : uniq) seen |= !strcmp(u.word, k.word);
+        if (!seen) uniq.push_back(k);
+      }
+      size_t n = uniq.size();
+      slot_bits_ = 0;
+      while ((size_t(1) << slot_bits_) < n + n/4) ++slot_bits_;
+      bucket_bits_ = 0;
+      while ((size_t(4) << bucket_bits_) < n) ++bucket_bits_;
+      seed_ = 0;
+      for (size_t attempt = 0; !place(uniq); ++attempt) {
+        seed_ = mix(seed_ + 0x9E3779B97F4A7C15ull);
+        if (attempt % 8 == 7) ++slot_bits_;
+      }
+    }
+
+  public:
+    Keyword_Table(std::initializer_list<Keyword> kws) {
+      build(std::vector<Keyword>(kws));
+    }
+
+    Keyword_Table(const std::vector<Keyword>& kws) {
+      build(kws);
+    }
+
+    // The kind of the keyword spelled by [b, e), or `none`.
+    int classify(const char* b, const char* e) const {
+      size_t n = e-b;
+      if (!n) return none;
+      uint64_t lo, hi;
+      head(b, n, lo, hi);
+      uint64_t h = hash(b, n, lo, hi);
+      const Slot& s = slots_[slot(h, disp_[bucket(h)])];
+      if (s.len != n || s.lo != lo || s.hi != hi) return none;
+      if (n > 16 && memcmp(rest_.data() + s.rest, b+16, n-16)) return none;
+      return s.kind;
+    }
+
+    // Matches `word` and classifies what it matched: `kind` is the keyword's
+    // kind, or `none` for an ordinary word. With a `follow` matcher, a
+    // keyword immediately followed by something `follow` matches is an
+    // ordinary word, like a keyword rule ending in `!follow`.
+    template<typename M>
+    const char* scan(const M& word, const char* b, const char* e, int& kind) const {
+      const char* p = word(b, e);
+      if (p) kind = classify(b, p);
+      return p;
+    }
+    template<typename M>
+    const char* scan(const M& word, const char* b, int& kind) const {
+      const char* p = word(b);
+      if (p) kind = classify(b, p);
+      return p;
+    }
+    template<typename M, typename F>
+    const char* scan(const M& word, const F& follow, const char* b, const char* e, int& kind) const {
+      const char* p = scan(word, b, e, kind);
+      if (p && kind != none && follow(p, e)) kind = none;
+      return p;
+    }
+    template<typename M, typename F>
+    const char* scan(const M& word, const F& follow, const char* b, int& kind) const {
+      const char* p = scan(word, b, kind);
+      if (p && kind != none && follow(p)) kind = none;
+      return p;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef MUNCHAR_LEXER
+#define MUNCHAR_LEXER
+
+#include "munchar.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+namespace Munchar {
+
+  // Push-mode lexing for input that arrives in chunks (pipes, sockets,
+  // decompressors). A scanner recognizes one token, and is a template on
+  // the input position like the matchers it's built from:
+  //
+  //   template<typename It>
+  //   It operator()(It b, It e, int& kind) const
+  //
+  // returning the token's end and setting its kind, or a null position. A
+  // Stream_Lexer feeds it each chunk in place and reports every token as
+  // `emit(token, text)`, where `text` points to the token's bytes for the
+  // duration of the call. Positions are passed as Util::Probe, which
+  // notices when a matcher runs into the end of the chunk: a token whose
+  // scan did that (including a scan that failed there) may depend on input
+  // that hasn't arrived, so its bytes are carried over and it is rescanned
+  // when the next chunk comes, joined with only as much of that chunk as it
+  // needs. Completed tokens are never rescanned, and only an unfinished
+  // token's bytes are kept. Scanners must use the bounded forms.
+
+  namespace Util {
+
+    // The operators of a byte pointer that watches how a scan uses it, for
+    // the position types below. `D` supplies three hooks: `read(q)`, called
+    // with one past each byte read; `ended(q)`, called when the position is
+    // compared against `q` and found not to be before it; and `moved()`,
+    // called when the position is stepped. `operator!` is defined so that
+    // `!p` doesn't resolve to the Negation combinator.
+    template<typename D>
+    class Watched_Pointer {
+      D& self() {
+        return static_cast<D&>(*this);
+      }
+      const D& self() const {
+        return static_cast<const D&>(*this);
+      }
+    protected:
+      const char* p_;
+      explicit Watched_Pointer(const char* p) : p_(p) { }
+    public:
+      const char* ptr() const {
+        return p_;
+      }
+      explicit operator bool() const {
+        return p_;
+      }
+      bool operator!() const {
+        return !p_;
+      }
+      char operator*() const {
+        self().read(p_+1);
+        return *p_;
+      }
+      char operator[](ptrdiff_t n) const {
+        self().read(p_+n+1);
+        return p_[n];
+      }
+      D& operator++() {
+        return *this += 1;
+      }
+      D operator++(int) {
+        D q = self();
+        ++*this;
+        return q;
+      }
+      D& operator--() {
+        return *this += -1;
+      }
+      D operator--(int) {
+        D q = self();
+        --*this;
+        return q;
+      }
+      D& operator+=(ptrdiff_t n) {
+        p_ += n;
+        self().moved();
+        return self();
+      }
+      D& operator-=(ptrdiff_t n) {
+        return *this += -n;
+      }
+      D operator+(ptrdiff_t n) const {
+        D q = self();
+        return q += n;
+      }
+      D operator-(ptrdiff_t n) const {
+        D q = self();
+        return q += -n;
+      }
+      ptrdiff_t operator-(const D& q) const {
+        return p_ - q.ptr();
+      }
+      bool operator==(const D& q) const {
+        return p_ == q.ptr();
+      }
+      bool operator!=(const D& q) const {
+        return p_ != q.ptr();
+      }
+      bool operator<(const D& q) const {
+        if (p_ < q.ptr()) return true;
+        self().ended(q);
+        return false;
+      }
+      bool operator>(const D& q) const {
+        return q < self();
+      }
+      bool operator<=(const D& q) const {
+        return !(q < self());
+      }
+      bool operator>=(const D& q) const {
+        return !(self() < q);
+      }
+    };
+
+    // A byte pointer that notices being compared against the end of the
+    // input and found not to be before it. Only the end position, as passed
+    // in, carries the flag; positions computed from it are ordinary.
+    class Probe : public Watched_Pointer<Probe> {
+      friend class Watched_Pointer<Probe>;
+      bool* hit_;
+      void read(const char*) const { }
+      void ended(const Probe& q) const {
+        if (q.hit_) *q.hit_ = true;
+      }
+      void moved() {
+        hit_ = nullptr;
+      }
+    public:
+      Probe() : Probe(nullptr) { }
+      Probe(std::nullptr_t) : Watched_Pointer(nullptr), hit_(nullptr) { }
+      explicit Probe(const char* p, bool* hit = nullptr) : Watched_Pointer(p), hit_(hit) { }
+    };
+
+  }
+
+  struct Token {
+    int kind;
+    size_t offset;      // from the start of the stream
+    size_t length;
+  };
+
+  template<typename S>
+  class Stream_Lexer {
+  public:
+    enum Status { need_more, done, error };
+  private:
+    const S scan_;
+    size_t max_token_;
+    std::string carry_;
+    size_t offset_;
+    bool failed_;
+
+    // Lexes the tokens that start before `stop`, seeing input up to `e`, and
+    // returns where lexing stopped; `b` is at the stream offset `offset_`.
+    template<typename F>
+    const char* run(const char* b, const char* stop, const char* e, bool last, F& emit) {
+      const char* p = b;
+      while (p < stop) {
+        int kind;
+        bool hit = false;
+        const char* q = this->scan_(Util::Probe { p }, Util::Probe { e, &hit }, kind).ptr();
+        if (hit && !last) break;
+        if (!q || q == p) {
+          failed_ = true;
+          break;
+        }
+        emit(Token { kind, offset_ + (p-b), size_t(q-p) }, p);
+        p = q;
+      }
+      return p;
+    }
+
+    Status held() {
+      if (carry_.size() > max_token_) failed_ = true;
+      return failed_ ? error : need_more;
+    }
+
+  public:
+    // A token longer than `max_token` bytes that is still unfinished at the
+    // end of a chunk is an error, which keeps memory bounded on bad input.
+    Stream_Lexer(const S& scan, size_t max_token = size_t(1) << 20)
+    : scan_(scan), max_token_(max_token), carry_(), offset_(0), failed_(false) { }
+
+    template<typename F>
+    Status feed(const char* b, const char* e, F emit) {
+      if (failed_) return error;
+      const char* c = b;
+      if (!carry_.empty()) {
+        // Tokens that start in carried bytes are lexed in a joined window,
+        // extended by doubling until they're finished or the chunk runs out.
+        size_t used = 0;
+        for (;;) {
+          size_t add = std::min(size_t(e-b) - used, std::max(carry_.size(), size_t(256)));
+          carry_.append(b+used, add);
+          used += add;
+          const char* cb = carry_.data();
+          const char* ce = cb + carry_.size();
+          const char* stop = ce - used;
+          const char* p = run(cb, stop, ce, false, emit);
+          offset_ += p-cb;
+          if (failed_) return error;
+          if (p >= stop) {
+            c = b + (p-stop);
+            carry_.clear();
+            break;
+          }
+          carry_.erase(0, p-cb);
+          if (used == size_t(e-b)) return held();
+        }
+      }
+      const char* p = run(c, e, e, false, emit);
+      offset_ += p-c;
+      if (failed_) return error;
+      carry_.assign(p, e);
+      return held();
+    }
+
+    // Ends the stream: whatever is carried over must now lex completely.
+    template<typename F>
+    Status finish(F emit) {
+      if (failed_) return error;
+      const char* b = carry_.data();
+      const char* e = b + carry_.size();
+      const char* p = run(b, e, e, true, emit);
+      offset_ += p-b;
+      carry_.erase(0, p-b);
+      return failed_ ? error : done;
+    }
+
+    // The stream offset of the first byte not yet lexed; after an error,
+    // where the bad token starts.
+    size_t offset() const {
+      return offset_;
+    }
+
+    // Bytes carried over, waiting for more input.
+    size_t pending() const {
+      return carry_.size();
+    }
+  };
+
+  template<typename S>
+  Stream_Lexer<S> stream_lexer(const S& scan, size_t max_token = size_t(1) << 20) {
+    return Stream_Lexer<S> { scan, max_token };
+  }
+
+}
+
+#endif
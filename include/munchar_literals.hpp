@@ -0,0 +1,285 @@
+#ifndef MUNCHAR_LITERALS
+#define MUNCHAR_LITERALS
+
+#include "munchar.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace Munchar {
+
+  // Result of a multi-literal search: which literal matched, and where.
+
+  struct Literal_Match {
+    size_t index;
+    const char* b;
+    const char* e;
+    Literal_Match() : index(0), b(nullptr), e(nullptr) { }
+    Literal_Match(size_t i, const char* beg, const char* end)
+    : index(i), b(beg), e(end) { }
+    explicit operator bool() const {
+      return b;
+    }
+    bool operator!() const {
+      return !b;
+    }
+  };
+
+  // A set of string literals, searched for all at once. Small sets are
+  // scanned with a two-byte fingerprint filter (one table lookup per byte for
+  // the first byte, one for the second, then verification of the surviving
+  // candidates); larger sets use an Aho-Corasick automaton over a compressed
+  // byte alphabet, so the transition table stays small enough for the cache.
+  // Searches report the leftmost match, preferring the longest literal when
+  // several start at the same position. Used as an ordinary matcher, the set
+  // matches the longest literal at the current position. A set built with
+  // `ignore_case` folds ASCII case: its literals are stored in lowercase,
+  // both cases of a letter share one byte class in the automaton and one
+  // fingerprint, and candidates are verified with a folding compare.
+
+  class Literal_Set {
+  public:
+    static const size_t fingerprint_limit = 32;
+  private:
+    std::vector<std::string> lits_;
+    bool icase_;
+    // fingerprint filter
+    uint32_t lead_[256];
+    uint32_t second_[256];
+    uint32_t short_;
+    int only_;
+    // Aho-Corasick automaton
+    unsigned char class_[256];
+    size_t classes_;
+    std::vector<int32_t> delta_;
+    std::vector<int32_t> out_;
+    std::vector<uint32_t> depth_;
+
+    size_t state(size_t s, unsigned char c) const {
+      return delta_[s*classes_ + class_[c]];
+    }
+
+    bool same(const char* p, const std::string& l) const {
+      if (!icase_) return !memcmp(p, l.data(), l.size());
+      for (size_t i = 0; i < l.size(); ++i) if (Util::fold(p[i]) != l[i]) return false;
+      return true;
+    }
+
+    void add(const char* s, size_t len) {
+      if (!len) return;
+      std::string lit(s, len);
+      if (icase_) for (auto& c : lit) c = Util::fold(c);
+      for (auto& l : lits_) if (l == lit) return;
+      lits_.push_back(lit);
+    }
+
+    void build() {
+      memset(lead_, 0, sizeof lead_);
+      memset(second_, 0, sizeof second_);
+      short_ = 0;
+      only_ = -1;
+      if (lits_.size() <= fingerprint_limit) {
+        for (size_t i = 0; i < lits_.size(); ++i) {
+          const unsigned char* s = reinterpret_cast<const unsigned char*>(lits_[i].data());
+          lead_[s[0]] |= uint32_t(1) << i;
+          if (lits_[i].size() > 1) second_[s[1]] |= uint32_t(1) << i;
+          else short_ |= uint32_t(1) << i;
+        }
+        if (icase_) {
+          for (char c = 'a'; c <= 'z'; ++c) {
+            lead_[static_cast<unsigned char>(Util::unfold(c))] = lead_[static_cast<unsigned char>(c)];
+            second_[static_cast<unsigned char>(Util::unfold(c))] = second_[static_cast<unsigned char>(c)];
+          }
+        }
+        for (size_t c = 0; c < 256; ++c) second_[c] |= short_;
+        for (size_t c = 0; c < 256; ++c) {
+          if (!lead_[c]) continue;
+          if (only_ >= 0) { only_ = -1; break; }
+          only_ = c;
+        }
+      }
+
+      // Bytes that never occur in a literal share class 0.
+      memset(class_, 0, sizeof class_);
+      classes_ = 1;
+      for (auto& l : lits_) for (unsigned char c : l) if (!class_[c]) class_[c] = classes_++;
+      if (icase_) for (char c = 'a'; c <= 'z'; ++c) class_[static_cast<unsigned char>(Util::unfold(c))] = class_[static_cast<unsigned char>(c)];
+
+      // Trie.
+      delta_.assign(classes_, -1);
+      out_.assign(1, -1);
+      depth_.assign(1, 0);
+      for (size_t i = 0; i < lits_.size(); ++i) {
+        size_t s = 0;
+        for (unsigned char c : lits_[i]) {
+          int32_t& t = delta_[s*classes_ + class_[c]];
+          if (t < 0) {
+            t = out_.size();
+            delta_.resize(delta_.size() + classes_, -1);
+            out_.push_back(-1);
+            depth_.push_back(depth_[s] + 1);
+          }
+          s = delta_[s*classes_ + class_[c]];
+        }
+        out_[s] = i;
+      }
+
+      // Failure links, folded into a complete transition table in BFS order.
+      std::vector<int32_t> fail(out_.size(), 0);
+      std::vector<size_t> queue;
+      for (size_t k = 0; k < classes_; ++k) {
+        int32_t& t = delta_[k];
+        if (t < 0) t = 0;
+        else queue.push_back(t);
+      }
+      for (size_t q = 0; q < queue.size(); ++q) {
+        size_t s = queue[q];
+        int32_t f = fail[s];
+        if (out_[s] < 0) out_[s] = out_[f];
+        for (size_t k = 0; k < classes_; ++k) {
+          int32_t& t = delta_[s*classes_ + k];
+          if (t < 0) t = delta_[f*classes_ + k];
+          else {
+            fail[t] = delta_[f*classes_ + k];
+            queue.push_back(t);
+          }
+        }
+      }
+    }
+
+    Literal_Match fingerprint(const char* b, const char* e) const {
+      for (const char* p = b; p < e; ++p) {
+        if (only_ >= 0) {
+          p = static_cast<const char*>(memchr(p, only_, e-p));
+          if (!p) break;
+        }
+        uint32_t m = lead_[static_cast<unsigned char>(*p)];
+        if (!m) continue;
+        m &= p+1 < e ? second_[static_cast<unsigned char>(p[1])] : short_;
+        size_t best = lits_.size();
+        for (size_t i = 0; m; ++i, m >>= 1) {
+          if (!(m & 1)) continue;
+          const std::string& l = lits_[i];
+          if (size_t(e-p) >= l.size() && same(p, l) &&
+              (best == lits_.size() || l.size() > lits_[best].size())) {
+            best = i;
+          }
+        }
+        if (best < lits_.size()) return Literal_Match { best, p, p+lits_[best].size() };
+      }
+      return Literal_Match { };
+    }
+
+    Literal_Match automaton(const char* b, const char* e) const {
+      Literal_Match r;
+      size_t s = 0;
+      for (const char* p = b; p < e; ++p) {
+        s = state(s, *p);
+        if (out_[s] >= 0) {
+          size_t i = out_[s];
+          const char* mb = p+1 - lits_[i].size();
+          if (!r || mb <= r.b) r = Literal_Match { i, mb, p+1 };
+        }
+        // no later match can start at or before the one already found
+        if (r && p+1 - depth_[s] > r.b) break;
+      }
+      return r;
+    }
+
+  public:
+    Literal_Set(std::initializer_list<const char*> lits, bool ignore_case = false)
+    : icase_(ignore_case) {
+      for (const char* l : lits) add(l, strlen(l));
+      build();
+    }
+
+    template<typename Ptr, bool with_len>
+    Literal_Set(std::initializer_list<Str<Ptr, with_len>> lits, bool ignore_case = false)
+    : icase_(ignore_case) {
+      for (auto& l : lits) add(l.data(), l.size());
+      build();
+    }
+
+    Literal_Set(const std::vector<std::string>& lits, bool ignore_case = false)
+    : icase_(ignore_case) {
+      for (auto& l : lits) add(l.data(), l.size());
+      build();
+    }
+
+    size_t size() const {
+      return lits_.size();
+    }
+
+    const std::string& operator[](size_t i) const {
+      return lits_[i];
+    }
+
+    Literal_Match find(const char* b, const char* e) const {
+      return lits_.size() <= fingerprint_limit ? fingerprint(b, e) : automaton(b, e);
+    }
+
+    Literal_Match find(const char* b) const {
+      return find(b, b+strlen(b));
+    }
+
+    // Calls `f(index, b, e)` for each non-overlapping match, left to right,
+    // and returns the number of matches.
+    template<typename F>
+    size_t find_all(const char* b, const char* e, F f) const {
+      size_t n = 0;
+      for (Literal_Match r; (r = find(b, e)); ++n, b = r.e) f(r.index, r.b, r.e);
+      return n;
+    }
+
+    template<typename F>
+    size_t find_all(const char* b, F f) const {
+      return find_all(b, b+strlen(b), f);
+    }
+
+    // Anchored matching walks trie edges only; in the completed automaton
+    // those are exactly the transitions that deepen the state by one.
+    const char* operator()(const char* b, const char* e) const {
+      const char* r = nullptr;
+      size_t s = 0;
+      for (const char* p = b; p < e; ++p) {
+        size_t t = state(s, *p);
+        if (depth_[t] != depth_[s] + 1) break;
+        s = t;
+        if (out_[s] >= 0 && lits_[out_[s]].size() == depth_[s]) r = p+1;
+      }
+      return r;
+    }
+    const char* operator()(const char* b) const {
+      const char* r = nullptr;
+      size_t s = 0;
+      for (const char* p = b; *p; ++p) {
+        size_t t = state(s, *p);
+        if (depth_[t] != depth_[s] + 1) break;
+        s = t;
+        if (out_[s] >= 0 && lits_[out_[s]].size() == depth_[s]) r = p+1;
+      }
+      return r;
+    }
+    template<typename Ctx>
+    const char* operator()(const char* b, const char* e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    bool first(Byte_Set& s) const {
+      for (auto& l : lits_) {
+        s.add(l[0]);
+        if (icase_) s.add(Util::unfold(l[0]));
+      }
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef MUNCHAR_NUMBERS
+#define MUNCHAR_NUMBERS
+
+#include "munchar.hpp"
+#include "munchar_tokens.hpp"
+#include <cfloat>
+#include <climits>
+#include <clocale>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace Munchar {
+  namespace Tokens {
+
+    // Value-producing counterparts of `integer`, `number_ne` and `number`.
+    // Each accepts exactly what the corresponding token accepts, returns the
+    // same end pointer, and stores the token's value in `v` while scanning,
+    // so there's no second pass through strtol/strtod. Integers that don't
+    // fit saturate as with strtoll. Doubles are computed exactly whenever
+    // the significand and power of ten are both exactly representable
+    // (Clinger's fast path, which covers nearly all numbers in stylesheets
+    // and scripts); anything else is handed to strtod in the "C" locale, so
+    // results are identical to strtod's either way.
+
+    namespace Util {
+
+      inline bool is_digit(char c) {
+        return static_cast<unsigned char>(c - '0') < 10;
+      }
+
+      // Eight ASCII digits at once, for little-endian targets.
+      inline bool eight_digits(const char* p, uint64_t& v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t w;
+        memcpy(&w, p, 8);
+        if ((w & 0xF0F0F0F0F0F0F0F0ull) != 0x3030303030303030ull ||
+            ((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) != 0x3030303030303030ull) {
+          return false;
+        }
+        w -= 0x3030303030303030ull;
+        w = (w * 10) + (w >> 8);
+        v = (((w & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+             (((w >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+        return true;
+#else
+        return false;
+#endif
+      }
+
+      inline double strtod_c(const char* b, const char* e) {
+        char buf[128];
+        std::string big;
+        const char* s = buf;
+        size_t n = e - b;
+        if (n < sizeof buf) {
+          memcpy(buf, b, n);
+          buf[n] = '\0';
+        }
+        else {
+          big.assign(b, n);
+          s = big.c_str();
+        }
+#ifdef LC_NUMERIC_MASK
+        static const locale_t c_locale = newlocale(LC_NUMERIC_MASK, "C", locale_t(0));
+        locale_t old = uselocale(c_locale);
+        double v = strtod(s, nullptr);
+        uselocale(old);
+        return v;
+#else
+        return strtod(s, nullptr);
+#endif
+      }
+
+      template<bool bounded>
+      const char* integer_value(const char* b, const char* e, long long& v) {
+        const char* p = b;
+        bool neg = false;
+        if (more<bounded>(p, e) && (*p == '+' || *p == '-')) neg = *p++ == '-';
+        const char* d = p;
+        uint64_t m = 0, w;
+        bool overflow = false;
+        if (bounded) for (; e-p >= 8 && m < 100000000000ull && eight_digits(p, w); p += 8) m = m*100000000 + w;
+        for (; more<bounded>(p, e) && is_digit(*p); ++p) {
+          unsigned c = *p - '0';
+          if (m > (UINT64_MAX - c) / 10) overflow = true;
+          else m = m*10 + c;
+        }
+        if (p == d) return nullptr;
+        uint64_t limit = neg ? uint64_t(LLONG_MAX) + 1 : uint64_t(LLONG_MAX);
+        if (overflow || m > limit) m = limit;
+        v = neg ? (m == uint64_t(LLONG_MAX) + 1 ? LLONG_MIN : -(long long)(m)) : (long long)(m);
+        return p;
+      }
+
+      template<bool bounded>
+      const char* number_value(const char* b, const char* e, double& v, bool exponent) {
+        static const double powers[] = {
+          1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+          1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        const char* p = b;
+        bool neg = false;
+        if (more<bounded>(p, e) && (*p == '+' || *p == '-')) neg = *p++ == '-';
+        uint64_t m = 0;
+        int digits = 0;      // significant digits held in m
+        long exp10 = 0;
+        bool inexact = false;
+        const char* int_b = p;
+        for (; more<bounded>(p, e) && is_digit(*p); ++p) {
+          if (digits < 19) {
+            m = m*10 + (*p - '0');
+            if (m) ++digits;
+          }
+          else {
+            ++exp10;
+            inexact |= *p != '0';
+          }
+        }
+        bool has_int = p != int_b;
+        if (more<bounded>(p, e) && *p == '.' && more<bounded>(p+1, e) && is_digit(p[1])) {
+          for (++p; more<bounded>(p, e) && is_digit(*p); ++p) {
+            if (digits < 19) {
+              m = m*10 + (*p - '0');
+              --exp10;
+              if (m) ++digits;
+            }
+            else {
+              inexact |= *p != '0';
+            }
+          }
+        }
+        else if (!has_int) {
+          return nullptr;
+        }
+        if (exponent && more<bounded>(p, e) && (*p == 'e' || *p == 'E')) {
+          const char* q = p+1;
+          bool eneg = false;
+          if (more<bounded>(q, e) && (*q == '+' || *q == '-')) eneg = *q++ == '-';
+          if (more<bounded>(q, e) && is_digit(*q)) {
+            long x = 0;
+            for (; more<bounded>(q, e) && is_digit(*q); ++q) if (x < 100000) x = x*10 + (*q - '0');
+            exp10 += eneg ? -x : x;
+            p = q;
+          }
+        }
+#if FLT_EVAL_METHOD == 0
+        if (!m) {
+          v = neg ? -0.0 : 0.0;
+          return p;
+        }
+        if (!inexact && m <= (uint64_t(1) << 53)) {
+          if (exp10 < 0 && exp10 >= -22) {
+            v = double(m) / powers[-exp10];
+            if (neg) v = -v;
+            return p;
+          }
+          // Shift surplus powers of ten into the significand while it stays
+          // exactly representable.
+          for (; exp10 > 22 && m <= (uint64_t(1) << 53) / 10; --exp10) m *= 10;
+          if (exp10 >= 0 && exp10 <= 22) {
+            v = double(m) * powers[exp10];
+            if (neg) v = -v;
+            return p;
+          }
+        }
+#endif
+        v = strtod_c(b, p);
+        return p;
+      }
+
+    }
+
+    inline const char* integer_value(const char* b, const char* e, long long& v) {
+      return Util::integer_value<true>(b, e, v);
+    }
+    inline const char* integer_value(const char* b, long long& v) {
+      return Util::integer_value<false>(b, nullptr, v);
+    }
+
+    inline const char* number_ne_value(const char* b, const char* e, double& v) {
+      return Util::number_value<true>(b, e, v, false);
+    }
+    inline const char* number_ne_value(const char* b, double& v) {
+      return Util::number_value<false>(b, nullptr, v, false);
+    }
+
+    inline const char* number_value(const char* b, const char* e, double& v) {
+      return Util::number_value<true>(b, e, v, true);
+    }
+    inline const char* number_value(const char* b, double& v) {
+      return Util::number_value<false>(b, nullptr, v, true);
+    }
+
+  }
+}
+
+#endif
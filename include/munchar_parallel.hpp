@@ -0,0 +1,152 @@
+#ifndef MUNCHAR_PARALLEL
+#define MUNCHAR_PARALLEL
+
+#include "munchar_lexer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace Munchar {
+
+  // Lexing one large buffer on several threads. The buffer is cut into
+  // chunks, each starting just after a newline, and every chunk is lexed at
+  // the same time as if a token started there; the scanner is the same as a
+  // Stream_Lexer's. Whether that guess was right (a chunk may really start
+  // inside a comment or a string) is settled afterwards, in order: the
+  // tokens of the chunks before say where lexing really enters each chunk,
+  // and since a scanner's result depends only on where it starts, the
+  // guessed tokens are correct from the first one that starts at a real
+  // token boundary. A chunk is relexed from where lexing really entered it
+  // only until its tokens line up with the guessed ones; when they never
+  // do, the chunk is relexed whole, so a bad guess costs time, not
+  // correctness. Errors are found exactly where one-thread lexing finds
+  // them.
+
+  template<typename S>
+  class Parallel_Lexer {
+    struct Chunk {
+      const char* b;          // guessed first token
+      const char* e;          // tokens start before here
+      const char* stop;       // where guessed lexing stopped
+      bool failed;
+      std::vector<Token> tokens;
+    };
+
+    const S scan_;
+    size_t threads_;
+    size_t min_chunk_;
+    size_t offset_;
+    size_t relexed_;
+
+    // Lexes the tokens starting in [c.b, c.e), seeing input up to `e`.
+    void guess(Chunk& c, const char* b, const char* e) const {
+      const char* p = c.b;
+      while (p < c.e) {
+        int kind;
+        const char* q = this->scan_(p, e, kind);
+        if (!q || q == p) {
+          c.failed = true;
+          break;
+        }
+        c.tokens.push_back(Token { kind, size_t(p-b), size_t(q-p) });
+        p = q;
+      }
+      c.stop = p;
+    }
+
+    std::vector<Chunk> split(const char* b, const char* e) const {
+      size_t n = threads_ ? threads_ : std::max(1u, std::thread::hardware_concurrency());
+      n = std::max(size_t(1), std::min(n, size_t(e-b) / std::max(min_chunk_, size_t(1))));
+      std::vector<Chunk> chunks;
+      const char* p = b;
+      for (size_t i = 1; i <= n; ++i) {
+        const char* q = i == n ? e : b + (e-b) / n * i;
+        if (q < e) {
+          const char* nl = static_cast<const char*>(memchr(q, '\n', e-q));
+          q = nl ? nl+1 : e;
+        }
+        if (q <= p) continue;
+        chunks.push_back(Chunk { p, q, p, false, std::vector<Token>() });
+        p = q;
+      }
+      return chunks;
+    }
+
+  public:
+    // With `threads` of 0, uses one thread per core; chunks are at least
+    // `min_chunk` bytes, so small inputs are lexed on the calling thread.
+    Parallel_Lexer(const S& scan, size_t threads = 0, size_t min_chunk = size_t(1) << 20)
+    : scan_(scan), threads_(threads), min_chunk_(min_chunk), offset_(0), relexed_(0) { }
+
+    // Appends the tokens of [b, e) to `out`, with offsets from `b`, and
+    // returns whether all of it lexed; if not, `out` holds the tokens before
+    // the error.
+    bool lex(const char* b, const char* e, std::vector<Token>& out) {
+      std::vector<Chunk> chunks = split(b, e);
+      std::vector<std::thread> workers;
+      for (size_t i = 1; i < chunks.size(); ++i) {
+        workers.emplace_back([this, &chunks, i, b, e] { this->guess(chunks[i], b, e); });
+      }
+      if (!chunks.empty()) guess(chunks[0], b, e);
+      for (auto& w : workers) w.join();
+
+      relexed_ = 0;
+      const char* p = b;
+      for (auto& c : chunks) {
+        if (p >= c.e) continue;     // a token spans the whole chunk
+        auto& t = c.tokens;
+        auto next = [&](const char* p) {
+          return std::lower_bound(t.begin(), t.end(), size_t(p-b), [](const Token& k, size_t o) {
+            return k.offset < o;
+          });
+        };
+        auto i = next(p);
+        const char* from = p;
+        while (p < c.e && (i == t.end() || i->offset != size_t(p-b))) {
+          int kind;
+          const char* q = this->scan_(p, e, kind);
+          if (!q || q == p) break;
+          out.push_back(Token { kind, size_t(p-b), size_t(q-p) });
+          p = q;
+          i = next(p);
+        }
+        relexed_ += p-from;
+        if (p < c.e && (i == t.end() || i->offset != size_t(p-b))) {
+          offset_ = p-b;
+          return false;
+        }
+        if (p < c.e) {
+          out.insert(out.end(), i, t.end());
+          p = c.stop;
+          if (c.failed) {
+            offset_ = p-b;
+            return false;
+          }
+        }
+      }
+      offset_ = p-b;
+      return true;
+    }
+
+    // Where the last lex stopped: the input's size, or where the bad token
+    // starts.
+    size_t offset() const {
+      return offset_;
+    }
+
+    // How many bytes the last lex had to relex because a guess was wrong.
+    size_t relexed() const {
+      return relexed_;
+    }
+  };
+
+  template<typename S>
+  Parallel_Lexer<S> parallel_lexer(const S& scan, size_t threads = 0, size_t min_chunk = size_t(1) << 20) {
+    return Parallel_Lexer<S> { scan, threads, min_chunk };
+  }
+
+}
+
+#endif
@@ -0,0 +1,459 @@
+#ifndef MUNCHAR_PIPELINE
+#define MUNCHAR_PIPELINE
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+namespace Munchar {
+
+  // Batch input. A Read_Pipeline reads a list of files ahead of the threads
+  // that lex them, so that reading the next files overlaps lexing the ones
+  // already read. A fixed pool of buffers (each followed by zero padding,
+  // like an Input_Buffer) is shared by reads in flight and files being
+  // lexed; a read starts whenever a buffer is free and fewer than `depth`
+  // reads are outstanding, and a buffer goes back to the pool when its
+  // file's callback returns. On Linux the reads are issued through io_uring
+  // from one thread, with plain system calls (liburing isn't needed); where
+  // io_uring is unavailable (older kernels, seccomp filters, other systems)
+  // `depth` threads issue preads instead. If the ring fails partway, the
+  // reads it has taken are waited for and the pread threads read the rest.
+
+  struct Loaded_File {
+    size_t index;       // position in the list of paths
+    const char* data;   // nullptr if the file couldn't be read
+    size_t size;
+    int error;          // errno value, or 0
+  };
+
+  namespace Util {
+
+#ifdef __linux__
+    // Just enough of an io_uring to queue reads and reap their completions.
+    // Only one thread may use a ring.
+    class Uring {
+      int fd_;
+      void* sq_ring_;
+      size_t sq_len_;
+      void* cq_ring_;
+      size_t cq_len_;
+      io_uring_sqe* sqes_;
+      size_t sqes_len_;
+      unsigned* sq_tail_;
+      unsigned* sq_mask_;
+      unsigned* sq_array_;
+      unsigned* cq_head_;
+      unsigned* cq_tail_;
+      unsigned* cq_mask_;
+      io_uring_cqe* cqes_;
+      unsigned queued_;
+
+      template<typename T>
+      static T* at(void* base, uint32_t off) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+      }
+
+      void close_ring() {
+        if (sqes_) munmap(sqes_, sqes_len_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_len_);
+        if (sq_ring_) munmap(sq_ring_, sq_len_);
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        sq_ring_ = cq_ring_ = nullptr;
+        sqes_ = nullptr;
+      }
+
+    public:
+      explicit Uring(unsigned entries)
+      : fd_(-1), sq_ring_(nullptr), sq_len_(0), cq_ring_(nullptr), cq_len_(0),
+        sqes_(nullptr), sqes_len_(0), queued_(0) {
+        io_uring_params p;
+        memset(std::addressof(p), 0, sizeof p);
+        fd_ = syscall(__NR_io_uring_setup, entries, std::addressof(p));
+        if (fd_ < 0) return;
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_len_ = cq_len_ = sq_len_ > cq_len_ ? sq_len_ : cq_len_;
+        void* sq = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED) {
+          close_ring();
+          return;
+        }
+        sq_ring_ = sq;
+        void* cq = single ? sq : mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+          close_ring();
+          return;
+        }
+        cq_ring_ = cq;
+        sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+          close_ring();
+          return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        sq_tail_ = at<unsigned>(sq, p.sq_off.tail);
+        sq_mask_ = at<unsigned>(sq, p.sq_off.ring_mask);
+        sq_array_ = at<unsigned>(sq, p.sq_off.array);
+        cq_head_ = at<unsigned>(cq, p.cq_off.head);
+        cq_tail_ = at<unsigned>(cq, p.cq_off.tail);
+        cq_mask_ = at<unsigned>(cq, p.cq_off.ring_mask);
+        cqes_ = at<io_uring_cqe>(cq, p.cq_off.cqes);
+      }
+
+      Uring(const Uring&) = delete;
+      Uring& operator=(const Uring&) = delete;
+
+      ~Uring() {
+        close_ring();
+      }
+
+      bool ok() const {
+        return fd_ >= 0;
+      }
+
+      // Queues a read; the caller keeps no more reads outstanding than the
+      // ring has entries.
+      void read(int fd, const iovec* iov, uint64_t off, uint64_t tag) {
+        unsigned tail = *sq_tail_;
+        unsigned i = tail & *sq_mask_;
+        io_uring_sqe* s = sqes_ + i;
+        memset(s, 0, sizeof *s);
+        s->opcode = IORING_OP_READV;
+        s->fd = fd;
+        s->addr = reinterpret_cast<uintptr_t>(iov);
+        s->len = 1;
+        s->off = off;
+        s->user_data = tag;
+        sq_array_[i] = i;
+        __atomic_store_n(sq_tail_, tail+1, __ATOMIC_RELEASE);
+        ++queued_;
+      }
+
+      // Submits the queued reads and waits for at least one completion.
+      bool wait() {
+        for (;;) {
+          long r = syscall(__NR_io_uring_enter, fd_, queued_, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+          if (r >= 0) {
+            queued_ -= r;
+            return true;
+          }
+          if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+        }
+      }
+
+      // Takes the next completion, if there is one.
+      bool next(uint64_t& tag, int& res) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+        const io_uring_cqe& c = cqes_[head & *cq_mask_];
+        tag = c.user_data;
+        res = c.res;
+        __atomic_store_n(cq_head_, head+1, __ATOMIC_RELEASE);
+        return true;
+      }
+
+      // Takes back the last read queued but not yet submitted, as after a
+      // failed `wait`.
+      bool unqueue(uint64_t& tag) {
+        if (!queued_) return false;
+        unsigned tail = *sq_tail_ - 1;
+        tag = sqes_[tail & *sq_mask_].user_data;
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        --queued_;
+        return true;
+      }
+
+      // Waits for the next completion without submitting anything, for
+      // draining a ring that `wait` has given up on. If waiting fails too,
+      // it polls the completion queue between yields; the kernel posts
+      // completions there either way.
+      void reap(uint64_t& tag, int& res) {
+        while (!next(tag, res)) {
+          if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) std::this_thread::yield();
+        }
+      }
+    };
+#else
+    class Uring {
+    public:
+      explicit Uring(unsigned) { }
+      bool ok() const { return false; }
+      void read(int, const iovec*, uint64_t, uint64_t) { }
+      bool wait() { return false; }
+      bool next(uint64_t&, int&) { return false; }
+      bool unqueue(uint64_t&) { return false; }
+      void reap(uint64_t&, int&) { }
+    };
+#endif
+
+    // Blocking queue of pointers; `pop` returns nullptr once the queue is
+    // closed and empty.
+    template<typename T>
+    class Handoff {
+      std::mutex lock_;
+      std::condition_variable ready_;
+      std::deque<T*> items_;
+      bool closed_;
+    public:
+      Handoff() : closed_(false) { }
+      void push(T* t) {
+        {
+          std::lock_guard<std::mutex> g(lock_);
+          items_.push_back(t);
+        }
+        ready_.notify_one();
+      }
+      T* pop() {
+        std::unique_lock<std::mutex> g(lock_);
+        ready_.wait(g, [this] { return !items_.empty() || closed_; });
+        if (items_.empty()) return nullptr;
+        T* t = items_.front();
+        items_.pop_front();
+        return t;
+      }
+      T* try_pop() {
+        std::lock_guard<std::mutex> g(lock_);
+        if (items_.empty()) return nullptr;
+        T* t = items_.front();
+        items_.pop_front();
+        return t;
+      }
+      void close() {
+        {
+          std::lock_guard<std::mutex> g(lock_);
+          closed_ = true;
+        }
+        ready_.notify_all();
+      }
+    };
+
+  }
+
+  class Read_Pipeline {
+    struct Slot {
+      char* buf;
+      size_t cap;
+      size_t size;
+      size_t done;
+      size_t index;
+      int fd;
+      int error;
+      iovec iov;
+    };
+
+    size_t depth_;
+    size_t padding_;
+    Util::Uring ring_;
+
+    bool reserve(Slot* s, size_t n) {
+      if (n + padding_ <= s->cap) return true;
+      char* p = static_cast<char*>(realloc(s->buf, n + padding_));
+      if (!p) {
+        s->error = ENOMEM;
+        return false;
+      }
+      s->buf = p;
+      s->cap = n + padding_;
+      return true;
+    }
+
+    // Reads what's left of a file of unknown size (a pipe, or a file in
+    // /proc) synchronously.
+    void read_stream(Slot* s) {
+      for (size_t cap = s->done + 64*1024; ; ) {
+        if (!reserve(s, cap)) return;
+        ssize_t r = ::read(s->fd, s->buf + s->done, cap - s->done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) {
+          s->error = errno;
+          return;
+        }
+        if (!r) break;
+        s->done += r;
+        if (s->done == cap) cap *= 2;
+      }
+      s->size = s->done;
+    }
+
+    // Opens the file and sizes the buffer; returns whether a read should be
+    // issued. Files that fail here, or whose size isn't known, are done.
+    bool open_file(Slot* s, size_t index, const char* path) {
+      s->index = index;
+      s->size = s->done = 0;
+      s->error = 0;
+      s->fd = open(path, O_RDONLY | O_CLOEXEC);
+      if (s->fd < 0) {
+        s->error = errno;
+        return false;
+      }
+      struct stat st;
+      if (fstat(s->fd, std::addressof(st)) != 0) {
+        s->error = errno;
+        return false;
+      }
+      if (!S_ISREG(st.st_mode) || !st.st_size) {
+        read_stream(s);
+        return false;
+      }
+      s->size = st.st_size;
+      return reserve(s, s->size);
+    }
+
+    // Points the slot's iovec at what remains to be read.
+    const iovec* rest(Slot* s) {
+      s->iov.iov_base = s->buf + s->done;
+      s->iov.iov_len = s->size - s->done < (size_t(1) << 30) ? s->size - s->done : size_t(1) << 30;
+      return std::addressof(s->iov);
+    }
+
+    // Reads what remains of a file of known size with pread.
+    void read_rest(Slot* s) {
+      while (s->done < s->size) {
+        const iovec* v = rest(s);
+        ssize_t r = pread(s->fd, v->iov_base, v->iov_len, s->done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) s->error = errno;
+        if (r <= 0) break;
+        s->done += r;
+      }
+    }
+
+    void finish(Slot* s, Util::Handoff<Slot>& ready) {
+      if (s->fd >= 0) close(s->fd);
+      s->fd = -1;
+      if (s->done < s->size) s->size = s->done;
+      if (!s->error) memset(s->buf + s->size, 0, padding_);
+      ready.push(s);
+    }
+
+    void drive_uring(const std::vector<std::string>& paths, Util::Handoff<Slot>& idle, Util::Handoff<Slot>& ready) {
+      size_t next = 0, in_flight = 0;
+      while (next < paths.size() || in_flight) {
+        while (next < paths.size() && in_flight < depth_) {
+          // Only block for a buffer when there's nothing to reap meanwhile.
+          Slot* s = in_flight ? idle.try_pop() : idle.pop();
+          if (!s) break;
+          if (open_file(s, next, paths[next].c_str())) {
+            ring_.read(s->fd, rest(s), s->done, reinterpret_cast<uintptr_t>(s));
+            ++in_flight;
+          }
+          else {
+            finish(s, ready);
+          }
+          ++next;
+        }
+        if (!in_flight) continue;
+        uint64_t tag;
+        int res;
+        if (!ring_.wait()) {
+          // The ring has stopped working, but the reads it took may still
+          // be writing into their buffers. Take back the reads it never
+          // took, wait for the others, and finish every file with pread.
+          for (; ring_.unqueue(tag); --in_flight) {
+            Slot* s = reinterpret_cast<Slot*>(uintptr_t(tag));
+            read_rest(s);
+            finish(s, ready);
+          }
+          for (; in_flight; --in_flight) {
+            ring_.reap(tag, res);
+            Slot* s = reinterpret_cast<Slot*>(uintptr_t(tag));
+            if (res > 0) s->done += res;
+            read_rest(s);
+            finish(s, ready);
+          }
+          drive_pread(paths, next, idle, ready);
+          return;
+        }
+        while (ring_.next(tag, res)) {
+          Slot* s = reinterpret_cast<Slot*>(uintptr_t(tag));
+          if (res == -EINTR || res == -EAGAIN) {
+            ring_.read(s->fd, rest(s), s->done, tag);
+            continue;
+          }
+          if (res < 0) s->error = -res;
+          else s->done += res;
+          if (res > 0 && s->done < s->size) {
+            ring_.read(s->fd, rest(s), s->done, tag);
+            continue;
+          }
+          finish(s, ready);
+          --in_flight;
+        }
+      }
+    }
+
+    // Reads the files from index `first` on.
+    void drive_pread(const std::vector<std::string>& paths, size_t first, Util::Handoff<Slot>& idle, Util::Handoff<Slot>& ready) {
+      std::atomic<size_t> next(first);
+      std::vector<std::thread> readers;
+      for (size_t t = 0; t < depth_; ++t) {
+        readers.emplace_back([&] {
+          for (size_t i; (i = next.fetch_add(1)) < paths.size(); ) {
+            Slot* s = idle.pop();
+            if (open_file(s, i, paths[i].c_str())) read_rest(s);
+            finish(s, ready);
+          }
+        });
+      }
+      for (auto& r : readers) r.join();
+    }
+
+  public:
+    // `depth` is the number of reads kept in flight; `io_uring` false forces
+    // the pread threads.
+    explicit Read_Pipeline(size_t depth = 16, size_t padding = 64, bool io_uring = true)
+    : depth_(depth ? depth : 1), padding_(padding), ring_(io_uring ? unsigned(depth_) : 0) { }
+
+    bool uses_io_uring() const {
+      return ring_.ok();
+    }
+
+    // Reads every file in `paths` and calls `f(file)` for each, as its read
+    // completes, on `workers` threads (so `f` must be safe to call
+    // concurrently). The file's bytes are valid until `f` returns.
+    template<typename F>
+    void run(const std::vector<std::string>& paths, size_t workers, F f) {
+      Util::Handoff<Slot> idle, ready;
+      std::vector<Slot> slots(depth_ + (workers ? workers : 1), Slot { nullptr, 0, 0, 0, 0, -1, 0, iovec() });
+      for (auto& s : slots) idle.push(std::addressof(s));
+      std::vector<std::thread> lexers;
+      for (size_t t = 0; t < (workers ? workers : 1); ++t) {
+        lexers.emplace_back([&] {
+          for (Slot* s; (s = ready.pop()); idle.push(s)) {
+            f(Loaded_File { s->index, s->error ? nullptr : s->buf, s->error ? 0 : s->size, s->error });
+          }
+        });
+      }
+      if (ring_.ok()) drive_uring(paths, idle, ready);
+      else drive_pread(paths, 0, idle, ready);
+      ready.close();
+      for (auto& t : lexers) t.join();
+      for (auto& s : slots) ::free(s.buf);
+    }
+  };
+
+}
+
+#endif
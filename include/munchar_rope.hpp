@@ -0,0 +1,233 @@
+#ifndef MUNCHAR_ROPE
+#define MUNCHAR_ROPE
+
+#include "munchar.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Munchar {
+
+  // Segmented input. A Rope is a sequence of byte ranges owned by the caller
+  // (the pieces of a piece table, the leaves of a rope, a list of network
+  // buffers) that reads as one document, and a Rope::Cursor is a position in
+  // it. Matchers accept cursors wherever they accept pointers, so a rule runs
+  // over the whole document, backtracking across segments included, without
+  // the document ever being copied into one buffer; building or editing a
+  // Rope only touches its list of segments.
+  //
+  // A cursor carries a pointer into its segment and the segment's end, so
+  // stepping forward is a pointer increment and a compare; only crossing into
+  // another segment, or jumping by an offset that leaves the segment, goes
+  // back to the rope. At the end of the rope a cursor reads as '\0', so the
+  // NUL-terminated forms work too. Cursors are invalidated by appending to
+  // or clearing the rope, not by changes to the bytes themselves.
+  //
+  // The contexts take cursors too: captures and trees are kept as cursors
+  // and offsets (`Captures<N, Rope::Cursor>`, `Basic_Tree<Rope::Cursor>`),
+  // and an interning sink copies a match out of the rope before interning
+  // it. Hand-written scanners (Function, the numeric and string scanners of
+  // Munchar::Tokens) and searching (Finder, Literal_Set, Batch) work on
+  // contiguous buffers only.
+
+  class Rope {
+    struct Segment {
+      const char* b;
+      const char* e;
+      size_t offset;
+    };
+
+    std::vector<Segment> segs_;
+    size_t size_;
+
+    static const char* nul() {
+      static const char z = '\0';
+      return &z;
+    }
+
+  public:
+    class Cursor {
+      friend class Rope;
+      const Rope* r_;
+      size_t i_;            // segment index; the segment count at the end
+      const char* p_;
+      const char* e_;       // end of segment i_
+
+      Cursor(const Rope* r, size_t i, const char* p)
+      : r_(r), i_(i), p_(p), e_(i < r->segs_.size() ? r->segs_[i].e : p) { }
+
+      const Segment& seg() const {
+        return r_->segs_[i_];
+      }
+
+    public:
+      Cursor() : r_(nullptr), i_(0), p_(nullptr), e_(nullptr) { }
+      Cursor(std::nullptr_t) : Cursor() { }
+
+      explicit operator bool() const {
+        return p_;
+      }
+      bool operator!() const {
+        return !p_;
+      }
+
+      // Offset from the start of the rope.
+      size_t offset() const {
+        return i_ < r_->segs_.size() ? seg().offset + (p_ - seg().b) : r_->size_;
+      }
+
+      // The contiguous bytes from here to the end of the segment.
+      const char* data() const {
+        return p_;
+      }
+      size_t available() const {
+        return e_ - p_;
+      }
+
+      char operator*() const {
+        return *p_;
+      }
+      char operator[](ptrdiff_t n) const {
+        return *(*this + n);
+      }
+
+      Cursor& operator++() {
+        if (++p_ == e_) {
+          if (++i_ < r_->segs_.size()) {
+            p_ = seg().b;
+            e_ = seg().e;
+          }
+          else {
+            p_ = e_ = nul();
+          }
+        }
+        return *this;
+      }
+      Cursor operator++(int) {
+        Cursor c = *this;
+        ++*this;
+        return c;
+      }
+      Cursor& operator--() {
+        if (i_ == r_->segs_.size() || p_ == seg().b) {
+          --i_;
+          p_ = e_ = seg().e;
+        }
+        --p_;
+        return *this;
+      }
+      Cursor operator--(int) {
+        Cursor c = *this;
+        --*this;
+        return c;
+      }
+
+      Cursor& operator+=(ptrdiff_t n) {
+        if (n >= 0 ? n < e_ - p_ : i_ < r_->segs_.size() && -n <= p_ - seg().b) p_ += n;
+        else *this = r_->at(offset() + n);
+        return *this;
+      }
+      Cursor& operator-=(ptrdiff_t n) {
+        return *this += -n;
+      }
+      Cursor operator+(ptrdiff_t n) const {
+        Cursor c = *this;
+        return c += n;
+      }
+      Cursor operator-(ptrdiff_t n) const {
+        Cursor c = *this;
+        return c += -n;
+      }
+      ptrdiff_t operator-(const Cursor& c) const {
+        return i_ == c.i_ ? p_ - c.p_ : ptrdiff_t(offset() - c.offset());
+      }
+
+      bool operator==(const Cursor& c) const {
+        return p_ == c.p_ && i_ == c.i_;
+      }
+      bool operator!=(const Cursor& c) const {
+        return !(*this == c);
+      }
+      bool operator<(const Cursor& c) const {
+        return i_ < c.i_ || (i_ == c.i_ && p_ < c.p_);
+      }
+      bool operator>(const Cursor& c) const {
+        return c < *this;
+      }
+      bool operator<=(const Cursor& c) const {
+        return !(c < *this);
+      }
+      bool operator>=(const Cursor& c) const {
+        return !(*this < c);
+      }
+    };
+
+    Rope() : size_(0) { }
+
+    // Empty segments are dropped, so every position has one representation.
+    void append(const char* b, const char* e) {
+      if (b == e) return;
+      segs_.push_back(Segment { b, e, size_ });
+      size_ += e-b;
+    }
+
+    void append(const char* s) {
+      append(s, s+strlen(s));
+    }
+
+    void clear() {
+      segs_.clear();
+      size_ = 0;
+    }
+
+    size_t size() const {
+      return size_;
+    }
+
+    size_t segments() const {
+      return segs_.size();
+    }
+
+    Cursor begin() const {
+      return segs_.empty() ? end() : Cursor { this, 0, segs_[0].b };
+    }
+
+    Cursor end() const {
+      return Cursor { this, segs_.size(), nul() };
+    }
+
+    // The position `offset` bytes into the rope, found by binary search over
+    // the segments.
+    Cursor at(size_t offset) const {
+      if (offset >= size_) return end();
+      size_t i = std::upper_bound(segs_.begin(), segs_.end(), offset, [](size_t o, const Segment& s) {
+        return o < s.offset;
+      }) - segs_.begin() - 1;
+      return Cursor { this, i, segs_[i].b + (offset - segs_[i].offset) };
+    }
+
+    // Copies the bytes of [b, e) to `out` one contiguous run at a time, and
+    // returns how many there were.
+    size_t copy(Cursor b, Cursor e, char* out) const {
+      size_t n = 0;
+      while (b < e) {
+        size_t k = b.i_ == e.i_ ? e.p_ - b.p_ : b.available();
+        memcpy(out + n, b.p_, k);
+        n += k;
+        b += k;
+      }
+      return n;
+    }
+
+    std::string str(Cursor b, Cursor e) const {
+      std::string s(e-b, '\0');
+      copy(b, e, &s[0]);
+      return s;
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef MUNCHAR_STRINGS
+#define MUNCHAR_STRINGS
+
+#include "munchar.hpp"
+#include "munchar_tokens.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Munchar {
+  namespace Tokens {
+
+    namespace Util {
+
+      // Nonzero iff some byte of `w` equals `c`.
+      inline uint64_t has_byte(uint64_t w, unsigned char c) {
+        uint64_t x = w ^ (0x0101010101010101ull * c);
+        return (x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull;
+      }
+
+      // Skips bytes that aren't among `stops`, eight at a time while there
+      // are eight bytes left in a bounded range. In NUL-terminated mode the
+      // terminator is always a stop.
+      template<bool bounded, size_t n>
+      inline const char* skip_plain(const char* p, const char* e, const char (&stops)[n]) {
+        if (bounded) {
+          for (uint64_t w; e-p >= 8; p += 8) {
+            memcpy(&w, p, 8);
+            uint64_t hit = 0;
+            for (size_t i = 0; i < n; ++i) hit |= has_byte(w, stops[i]);
+            if (hit) break;
+          }
+        }
+        for (; bounded ? p < e : *p != '\0'; ++p) {
+          for (size_t i = 0; i < n; ++i) if (*p == stops[i]) return p;
+        }
+        return p;
+      }
+
+      // Appends the UTF-8 encoding of `c` (at most four bytes).
+      inline char* encode_utf8(uint32_t c, char* o) {
+        if (c < 0x80) {
+          *o++ = char(c);
+        }
+        else if (c < 0x800) {
+          *o++ = char(0xC0 | (c >> 6));
+          *o++ = char(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+          *o++ = char(0xE0 | (c >> 12));
+          *o++ = char(0x80 | ((c >> 6) & 0x3F));
+          *o++ = char(0x80 | (c & 0x3F));
+        }
+        else {
+          *o++ = char(0xF0 | (c >> 18));
+          *o++ = char(0x80 | ((c >> 12) & 0x3F));
+          *o++ = char(0x80 | ((c >> 6) & 0x3F));
+          *o++ = char(0x80 | (c & 0x3F));
+        }
+        return o;
+      }
+
+      inline char unescape_char(char c) {
+        switch (c) {
+          case 'n': return '\n';
+          case 't': return '\t';
+          case 'r': return '\r';
+          case 'f': return '\f';
+          case 'v': return '\v';
+          case 'b': return '\b';
+          case 'a': return '\a';
+          case '0': return '\0';
+          default:  return c;
+        }
+      }
+
+      template<bool bounded>
+      const char* string_value(const char* b, const char* e, char* out, size_t& n, bool& escaped) {
+        const char* p = b;
+        if (!more<bounded>(p, e) || (*p != '"' && *p != '\'')) return nullptr;
+        const char stops[] = { *p, '\\' };
+        const char* run = ++p;
+        char* o = out;
+        escaped = false;
+        for (;;) {
+          p = skip_plain<bounded>(p, e, stops);
+          if (!more<bounded>(p, e) || (!bounded && *p == '\0')) return nullptr;
+          if (*p == stops[0]) {
+            if (escaped) {
+              memcpy(o, run, p-run);
+              n = o-out + (p-run);
+            }
+            else {
+              n = p-run;
+            }
+            return p+1;
+          }
+          if (!more<bounded>(p+1, e) || (!bounded && p[1] == '\0')) return nullptr;
+          escaped = true;
+          memcpy(o, run, p-run);
+          o += p-run;
+          *o++ = unescape_char(p[1]);
+          run = p += 2;
+        }
+      }
+
+    }
+
+    // Decoding counterparts of `string` (`dq_string | sq_string`). Besides
+    // matching, they write the literal's contents with escape sequences
+    // decoded (\n, \t, \r, \f, \v, \b, \a and \0 as in C; a backslash before
+    // anything else stands for that character) into `out`, which must have
+    // room for as many bytes as the literal spans. Runs without escapes are
+    // found eight bytes at a time and copied in bulk. When the literal
+    // contains no escapes, `escaped` is false and nothing is written: the
+    // contents are the `n` bytes after the opening quote in the source.
+
+    inline const char* string_value(const char* b, const char* e, char* out, size_t& n, bool& escaped) {
+      return Util::string_value<true>(b, e, out, n, escaped);
+    }
+    inline const char* string_value(const char* b, char* out, size_t& n, bool& escaped) {
+      return Util::string_value<false>(b, nullptr, out, n, escaped);
+    }
+
+  }
+}
+
+#endif
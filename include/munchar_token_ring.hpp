@@ -0,0 +1,152 @@
+#ifndef MUNCHAR_TOKEN_RING
+#define MUNCHAR_TOKEN_RING
+
+#include "munchar_lexer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace Munchar {
+
+  // Pipelined lexing and parsing. A Token_Ring carries tokens from one
+  // lexing thread to one parsing thread without locks: the lexer writes
+  // tokens into the ring and publishes them a batch at a time (eight tokens,
+  // three cache lines), and the parser takes them one at a time, releasing
+  // the slots it has read a batch at a time too, so the two threads touch
+  // each other's index once per batch rather than once per token. The ring
+  // has a fixed capacity; a lexer that gets that far ahead waits for the
+  // parser, so memory stays bounded however long the document. Waiting
+  // spins briefly, then yields.
+  //
+  // A ring carries one stream. `lex_pipelined` runs a scanner (as for a
+  // Stream_Lexer) on a new thread and the parser on the calling thread.
+
+  class Token_Ring {
+    static const size_t line = 64;
+
+    std::unique_ptr<Token[]> slots_;
+    size_t mask_;
+    char pad0_[line];
+    // Written by the producer.
+    std::atomic<size_t> tail_;
+    std::atomic<bool> closed_;
+    char pad1_[line];
+    // Written by the consumer.
+    std::atomic<size_t> head_;
+    std::atomic<bool> cancelled_;
+    char pad2_[line];
+    // The producer's own state.
+    size_t write_;
+    size_t head_seen_;
+    char pad3_[line];
+    // The consumer's own state.
+    size_t read_;
+    size_t tail_seen_;
+
+    static void pause(unsigned& spins) {
+      if (++spins > 64) std::this_thread::yield();
+    }
+
+  public:
+    static const size_t batch = 8;
+
+    // The capacity is rounded up to a power of two of at least two batches.
+    explicit Token_Ring(size_t capacity = 4096)
+    : slots_(), mask_(0), tail_(0), closed_(false), head_(0), cancelled_(false),
+      write_(0), head_seen_(0), read_(0), tail_seen_(0) {
+      size_t n = 2*batch;
+      while (n < capacity) n *= 2;
+      slots_.reset(new Token[n]);
+      mask_ = n-1;
+    }
+
+    Token_Ring(const Token_Ring&) = delete;
+    Token_Ring& operator=(const Token_Ring&) = delete;
+
+    size_t capacity() const {
+      return mask_+1;
+    }
+
+    // Producer: adds a token, waiting while the ring is full. Returns false,
+    // dropping the token, once the consumer has cancelled.
+    bool push(const Token& t) {
+      if (write_ - head_seen_ > mask_) {
+        unsigned spins = 0;
+        while ((head_seen_ = head_.load(std::memory_order_acquire), write_ - head_seen_ > mask_)) {
+          if (cancelled_.load(std::memory_order_relaxed)) return false;
+          pause(spins);
+        }
+      }
+      slots_[write_ & mask_] = t;
+      if (++write_ % batch == 0) tail_.store(write_, std::memory_order_release);
+      return true;
+    }
+
+    // Producer: publishes a partial batch.
+    void flush() {
+      tail_.store(write_, std::memory_order_release);
+    }
+
+    // Producer: publishes what's left and ends the stream.
+    void close() {
+      flush();
+      closed_.store(true, std::memory_order_release);
+    }
+
+    // Consumer: takes the next token, waiting for one; false at the end of
+    // the stream.
+    bool next(Token& t) {
+      if (read_ == tail_seen_) {
+        unsigned spins = 0;
+        for (;;) {
+          // Read `closed_` first: if it's set, the last tail is visible.
+          bool closed = closed_.load(std::memory_order_acquire);
+          tail_seen_ = tail_.load(std::memory_order_acquire);
+          if (read_ != tail_seen_) break;
+          if (closed) {
+            head_.store(read_, std::memory_order_release);
+            return false;
+          }
+          pause(spins);
+        }
+      }
+      t = slots_[read_ & mask_];
+      if (++read_ % batch == 0) head_.store(read_, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer: stops taking tokens, releasing a producer that is waiting.
+    void cancel() {
+      cancelled_.store(true, std::memory_order_relaxed);
+    }
+  };
+
+  // Lexes [b, e) with `scan` on a new thread while `parse(ring)` consumes
+  // the tokens on this one, through a ring of `capacity` tokens. Returns
+  // whether the whole input lexed and `parse` returned true; `stop` is where
+  // lexing stopped (where the bad token starts, after an error). A parser
+  // that gives up early needn't drain the ring.
+  template<typename S, typename F>
+  bool lex_pipelined(const S& scan, const char* b, const char* e, F parse, size_t& stop, size_t capacity = 4096) {
+    Token_Ring ring { capacity };
+    const char* p = b;
+    std::thread lexer([&] {
+      while (p < e) {
+        int kind;
+        const char* q = scan(p, e, kind);
+        if (!q || q == p || !ring.push(Token { kind, size_t(p-b), size_t(q-p) })) break;
+        p = q;
+      }
+      ring.close();
+    });
+    bool parsed = parse(ring);
+    ring.cancel();
+    lexer.join();
+    stop = p-b;
+    return parsed && p == e;
+  }
+
+}
+
+#endif
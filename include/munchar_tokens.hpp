@@ -89,6 +89,16 @@ namespace Munchar {
     constexpr auto c_comment     = STR("/*") ^ *(!STR("*/") ^ _) ^ STR("*/");
     constexpr auto sh_comment    = CHR('#') ^ *(!eol ^ _) ^ ~eol;
 
+    namespace Util {
+      // End-of-input test for hand-written scanners that serve both the
+      // bounded and the NUL-terminated interface. Unbounded scanners rely on
+      // their character tests rejecting the terminator.
+      template<bool bounded>
+      inline bool more(const char* p, const char* e) {
+        return !bounded || p < e;
+      }
+    }
+
   }
 }
 
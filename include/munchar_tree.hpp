@@ -0,0 +1,171 @@
+#ifndef MUNCHAR_TREE
+#define MUNCHAR_TREE
+
+#include "munchar.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Munchar {
+
+  // Concrete syntax trees. `node<Tag>(m)` records a node for each match of
+  // `m` when matched with `m(b, e, tree)`; nodes matched inside it become its
+  // children. Nodes are stored contiguously in pre-order and linked by index,
+  // so building a tree is a bump of the node array per node, and discarding
+  // a failed branch is a truncation of the array back to a mark. Node
+  // offsets are measured from a base position, a pointer for a Tree or any
+  // other position type for a Basic_Tree (`Basic_Tree<Rope::Cursor>`).
+
+  struct Node {
+    static const uint32_t none = uint32_t(-1);
+    uint32_t tag;
+    uint32_t begin;
+    uint32_t length;
+    uint32_t first_child;
+    uint32_t next_sibling;
+  };
+
+  template<typename P = const char*>
+  class Basic_Tree {
+    P base_;
+    std::vector<Node> nodes_;
+    uint32_t first_root_;
+    uint32_t parent_;
+    uint32_t last_;
+
+    void link(uint32_t i) {
+      if (last_ != Node::none) nodes_[last_].next_sibling = i;
+      else if (parent_ != Node::none) nodes_[parent_].first_child = i;
+      else first_root_ = i;
+      last_ = i;
+    }
+
+  public:
+    struct Mark {
+      size_t size;
+      uint32_t parent;
+      uint32_t last;
+    };
+
+    struct Frame {
+      uint32_t node;
+      uint32_t parent;
+      uint32_t last;
+    };
+
+    Basic_Tree(P base, size_t reserve = 0)
+    : base_(base), first_root_(Node::none), parent_(Node::none), last_(Node::none) {
+      nodes_.reserve(reserve);
+    }
+
+    Mark mark() const {
+      return Mark { nodes_.size(), parent_, last_ };
+    }
+
+    // Everything after the mark is dropped, and the one link that may have
+    // been made to it from before the mark is cut.
+    void rollback(const Mark& m) {
+      nodes_.resize(m.size);
+      parent_ = m.parent;
+      last_ = m.last;
+      if (last_ != Node::none) nodes_[last_].next_sibling = Node::none;
+      else if (parent_ != Node::none) nodes_[parent_].first_child = Node::none;
+      else first_root_ = Node::none;
+    }
+
+    Frame open(uint32_t tag, P b) {
+      Frame f = { uint32_t(nodes_.size()), parent_, last_ };
+      Node n = { tag, uint32_t(b - base_), 0, Node::none, Node::none };
+      nodes_.push_back(n);
+      parent_ = f.node;
+      last_ = Node::none;
+      return f;
+    }
+
+    void close(const Frame& f, P b, P e) {
+      nodes_[f.node].length = uint32_t(e - b);
+      parent_ = f.parent;
+      last_ = f.last;
+      link(f.node);
+    }
+
+    void abandon(const Frame& f) {
+      nodes_.resize(f.node);
+      parent_ = f.parent;
+      last_ = f.last;
+    }
+
+    void clear() {
+      nodes_.clear();
+      first_root_ = parent_ = last_ = Node::none;
+    }
+
+    P base() const {
+      return base_;
+    }
+
+    const std::vector<Node>& nodes() const {
+      return nodes_;
+    }
+
+    const Node& operator[](uint32_t i) const {
+      return nodes_[i];
+    }
+
+    uint32_t root() const {
+      return first_root_;
+    }
+
+    size_t size() const {
+      return nodes_.size();
+    }
+  };
+
+  typedef Basic_Tree<> Tree;
+
+  template<uint32_t Tag, typename M>
+  class Tree_Node {
+    const M m_;
+  public:
+    constexpr Tree_Node(const M& m) : m_(m) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      return this->m_(b, e);
+    }
+    template<typename It>
+    It operator()(It b) const {
+      return this->m_(b);
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      typename Ctx::Frame f = ctx.open(Tag, b);
+      It p = this->m_(b, e, ctx);
+      if (p) ctx.close(f, b, p);
+      else ctx.abandon(f);
+      return p;
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      return reverse(b, e, e);
+    }
+    template<typename It>
+    It reverse(It b, It e, It end) const {
+      return Util::reverse(this->m_, b, e, end);
+    }
+    bool first(Byte_Set& s) const {
+      return this->m_.first(s);
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return this->m_.compile(p);
+    }
+  };
+
+  template<uint32_t Tag, typename M>
+  constexpr Tree_Node<Tag, M> node(const M& m) {
+    return Tree_Node<Tag, M> { m };
+  }
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef MUNCHAR_UTF8
+#define MUNCHAR_UTF8
+
+#include "munchar.hpp"
+#include "munchar_unicode_tables.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Munchar {
+
+  // Codepoint-level matching. A codepoint matcher consumes one well-formed
+  // UTF-8 sequence (shortest form, no surrogates, nothing past U+10FFFF)
+  // whose codepoint satisfies a test: a range, or a Unicode property looked
+  // up in two-level tables (a block index per 256 codepoints, then a bit per
+  // codepoint in a shared pool of blocks). ASCII bytes skip decoding
+  // entirely, so rules over mostly-ASCII input run at byte-matcher speed.
+  // On char16_t input the matchers decode UTF-16 (a lone surrogate never
+  // matches), and on char32_t input each unit is a codepoint.
+
+  namespace Util {
+
+    template<bool bounded>
+    inline const char* decode_utf8(const char* b, const char* e, uint32_t& c) {
+      static const uint32_t least[] = { 0, 0, 0x80, 0x800, 0x10000 };
+      unsigned char c0 = *b;
+      if (c0 < 0x80) {
+        c = c0;
+        return b+1;
+      }
+      if (c0 < 0xC2 || c0 > 0xF4) return nullptr;
+      size_t n = c0 < 0xE0 ? 2 : c0 < 0xF0 ? 3 : 4;
+      if (bounded && size_t(e-b) < n) return nullptr;
+      uint32_t r = c0 & (0x7F >> n);
+      // A terminator isn't a continuation byte, so NUL-terminated input is
+      // never read past its end.
+      for (size_t i = 1; i < n; ++i) {
+        unsigned char x = b[i];
+        if ((x & 0xC0) != 0x80) return nullptr;
+        r = (r << 6) | (x & 0x3F);
+      }
+      if (r < least[n] || r > 0x10FFFF || (r >= 0xD800 && r <= 0xDFFF)) return nullptr;
+      c = r;
+      return b+n;
+    }
+
+    inline const char* decode_utf8(const char* b, const char* e, uint32_t& c) {
+      return b < e ? decode_utf8<true>(b, e, c) : nullptr;
+    }
+
+    inline const char* decode_utf8(const char* b, uint32_t& c) {
+      return *b ? decode_utf8<false>(b, nullptr, c) : nullptr;
+    }
+
+    template<bool bounded>
+    inline const char* decode(const char* b, const char* e, uint32_t& c) {
+      return decode_utf8<bounded>(b, e, c);
+    }
+
+    template<bool bounded>
+    inline const char16_t* decode(const char16_t* b, const char16_t* e, uint32_t& c) {
+      uint32_t u = *b;
+      if (u < 0xD800 || u > 0xDFFF) {
+        c = u;
+        return b+1;
+      }
+      if (u > 0xDBFF || (bounded && e-b < 2) || b[1] < 0xDC00 || b[1] > 0xDFFF) return nullptr;
+      c = 0x10000 + ((u - 0xD800) << 10) + (b[1] - 0xDC00);
+      return b+2;
+    }
+
+    template<bool bounded>
+    inline const char32_t* decode(const char32_t* b, const char32_t* e, uint32_t& c) {
+      c = *b;
+      return c <= 0x10FFFF && (c < 0xD800 || c > 0xDFFF) ? b+1 : nullptr;
+    }
+
+    // Any other iterator is taken to be over UTF-8 bytes; the sequence is
+    // gathered into a buffer and decoded there.
+    template<bool bounded, typename It>
+    inline It decode(It b, It e, uint32_t& c) {
+      char u[4];
+      size_t n = 0;
+      for (It p = b; n < 4 && (bounded ? p < e : *p != '\0'); ++p) u[n++] = *p;
+      const char* q = decode_utf8<true>(u, u+n, c);
+      return q ? b + (q-u) : It();
+    }
+
+    // Units that continue a sequence rather than start one.
+    inline bool is_trail(char c) {
+      return (c & 0xC0) == 0x80;
+    }
+    inline bool is_trail(char16_t c) {
+      return c >= 0xDC00 && c <= 0xDFFF;
+    }
+    inline bool is_trail(char32_t c) {
+      return false;
+    }
+
+    class Codepoint_Range {
+      uint32_t lo_;
+      uint32_t hi_;
+    public:
+      constexpr Codepoint_Range(uint32_t lo, uint32_t hi) : lo_(lo), hi_(hi) { }
+      constexpr bool operator()(uint32_t c) const {
+        return lo_ <= c && c <= hi_;
+      }
+    };
+
+    class Codepoint_Property {
+      const uint8_t* stage1_;
+    public:
+      constexpr Codepoint_Property(const uint8_t* stage1) : stage1_(stage1) { }
+      bool operator()(uint32_t c) const {
+        return c <= 0x10FFFF && (Unicode::Tables::blocks[stage1_[c >> 8]][(c & 0xFF) >> 3] >> (c & 7)) & 1;
+      }
+    };
+
+  }
+
+  template<typename T>
+  class Codepoint {
+    const T t_;
+  public:
+    constexpr Codepoint(const T& t) : t_(t) { }
+    template<typename It>
+    It operator()(It b, It e) const {
+      if (!(b < e)) return nullptr;
+      if (Util::unit(*b) < 0x80) return this->t_(Util::unit(*b)) ? b+1 : nullptr;
+      uint32_t c;
+      It p = Util::decode<true>(b, e, c);
+      return p && this->t_(c) ? p : nullptr;
+    }
+    template<typename It>
+    It operator()(It b) const {
+      if (!*b) return nullptr;
+      if (Util::unit(*b) < 0x80) return this->t_(Util::unit(*b)) ? b+1 : nullptr;
+      uint32_t c;
+      It p = Util::decode<false>(b, It(), c);
+      return p && this->t_(c) ? p : nullptr;
+    }
+    template<typename It, typename Ctx>
+    It operator()(It b, It e, Ctx& ctx) const {
+      return (*this)(b, e);
+    }
+    template<typename It>
+    It reverse(It b, It e) const {
+      if (!(b < e)) return nullptr;
+      It q = e-1;
+      while (q > b && e-q < 4 && Util::is_trail(*q)) --q;
+      return (*this)(q, e) == e ? q : nullptr;
+    }
+    bool first(Byte_Set& s) const {
+      for (size_t c = 0; c < 0x80; ++c) if (this->t_(c)) s.add(c);
+      for (size_t c = 0xC2; c <= 0xF4; ++c) s.add(c);
+      return false;
+    }
+    template<typename P>
+    bool compile(P& p) const {
+      return false;
+    }
+  };
+
+  constexpr Codepoint<Util::Codepoint_Range> CP(uint32_t c) {
+    return Codepoint<Util::Codepoint_Range> { Util::Codepoint_Range { c, c } };
+  }
+
+  constexpr Codepoint<Util::Codepoint_Range> CP_RANGE(uint32_t lo, uint32_t hi) {
+    return Codepoint<Util::Codepoint_Range> { Util::Codepoint_Range { lo, hi } };
+  }
+
+  constexpr Codepoint<Util::Codepoint_Property> CP_PROPERTY(const uint8_t* table) {
+    return Codepoint<Util::Codepoint_Property> { Util::Codepoint_Property { table } };
+  }
+
+  // Whole-buffer UTF-8 validation, for checking input once before lexing.
+  // Runs of ASCII are skipped sixteen bytes at a time; other bytes go
+  // through a small DFA with one state per kind of pending continuation.
+  // The DFA is packed into one 64-bit row per byte value, holding the next
+  // state for every current state as a shift amount, so each byte costs one
+  // load and one shift and validation never decodes codepoints. The result
+  // also says whether the buffer is pure ASCII, in which case byte-level
+  // rules can be used on it unchanged.
+
+  struct Utf8_Status {
+    bool valid;
+    bool ascii;
+    const char* error;    // start of the first malformed sequence, or nullptr
+  };
+
+  namespace Util {
+
+    enum { utf8_accept = 0, utf8_reject = 6 };
+
+    constexpr uint8_t utf8_class[256] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      11, 11, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 7, 6, 6, 8, 9, 9, 9, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11
+    };
+
+    // Classes: ASCII, 80-8F, 90-9F, A0-BF, C2-DF, E0, E1-EC/EE-EF, ED, F0,
+    // F1-F3, F4, invalid. States: accept, reject, then the continuations
+    // still expected (with E0, ED, F0 and F4 restricting the next byte).
+    constexpr uint8_t utf8_next[9][12] = {
+      { 0, 1, 1, 1, 2, 4, 3, 5, 7, 6, 8, 1 },
+      { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 1, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }
+    };
+
+    struct Utf8_Rows {
+      uint64_t row[256];
+      Utf8_Rows() {
+        for (size_t c = 0; c < 256; ++c) {
+          row[c] = 0;
+          for (size_t s = 0; s < 9; ++s) row[c] |= uint64_t(utf8_next[s][utf8_class[c]] * 6) << (s * 6);
+        }
+      }
+    };
+
+    inline const uint64_t* utf8_rows() {
+      static const Utf8_Rows rows;
+      return rows.row;
+    }
+
+  }
+
+  inline Utf8_Status check_utf8(const char* b, const char* e) {
+    const uint64_t* rows = Util::utf8_rows();
+    Utf8_Status r = { true, true, nullptr };
+    const char* p = b;
+    unsigned high = 0;
+    uint64_t s = Util::utf8_accept;
+    while (p < e) {
+      if (s == Util::utf8_accept) {
+        for (uint64_t w[2]; e-p >= 16; p += 16) {
+          memcpy(w, p, 16);
+          if ((w[0] | w[1]) & 0x8080808080808080ull) break;
+        }
+      }
+      for (const char* q = e-p > 16 ? p+16 : e; p < q; ++p) {
+        unsigned char c = *p;
+        high |= c;
+        s = (rows[c] >> s) & 63;
+      }
+      if (s == Util::utf8_reject) break;
+    }
+    r.ascii = !(high & 0x80);
+    if (s != Util::utf8_accept) {
+      // Find where the malformed sequence starts.
+      uint32_t c;
+      for (const char* q = p = b; p < e && (q = Util::decode_utf8<true>(p, e, c)); p = q) ;
+      r.valid = false;
+      r.error = p;
+      r.ascii = false;
+    }
+    return r;
+  }
+
+  inline Utf8_Status check_utf8(const char* b) {
+    return check_utf8(b, b+strlen(b));
+  }
+
+  namespace Unicode {
+
+    constexpr auto any          = CP_RANGE(0, 0x10FFFF);
+    constexpr auto non_ascii    = CP_RANGE(0x80, 0x10FFFF);
+    constexpr auto letter       = CP_PROPERTY(Tables::letter);
+    constexpr auto xid_start    = CP_PROPERTY(Tables::xid_start);
+    constexpr auto xid_continue = CP_PROPERTY(Tables::xid_continue);
+    constexpr auto identifier   = (xid_start | CHR('_')) ^ *xid_continue;
+
+  }
+
+}
+
+#endif
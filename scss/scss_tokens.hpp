@@ -3,7 +3,11 @@
 
 #include "../include/munchar.hpp"
 #include "../include/munchar_tokens.hpp"
+#include "../include/munchar_strings.hpp"
+#include "../include/munchar_utf8.hpp"
 #include <cctype>
+#include <cstdint>
+#include <cstring>
 
 namespace Sass {
   namespace Tokens {
@@ -14,13 +18,7 @@ namespace Sass {
     constexpr auto nl       = CHR('\n') | STR("\r\n") | CHR('\r') | CHR('\f');
     constexpr auto unicode  = CHR('\\') ^ between(1,6,h) ^ ~CLS(" \t\r\n\f");
 
-    namespace Util {
-      inline constexpr bool isnonascii(unsigned char c) {
-        return c > 127;
-      }
-    }
-
-    constexpr auto nonascii = MUNCHAR_STATIC_PREDICATE(Util::isnonascii);
+    constexpr auto nonascii = Munchar::Unicode::non_ascii;
     constexpr auto escape   = unicode | Munchar::Tokens::escape_seq;
     constexpr auto nmstart  = Munchar::Tokens::id_start | nonascii | escape;
     constexpr auto nmchar   = Munchar::Tokens::alphanumeric |
@@ -55,7 +53,7 @@ namespace Sass {
 
     constexpr auto hash = CHR('#') ^ name;
 
-    constexpr auto important = CHR('!') ^ w ^ STR("important");
+    constexpr auto important = CHR('!') ^ w ^ ISTR("important");
 
     constexpr auto number = num ^ ~(ident | CHR('%'));
 
@@ -115,10 +113,10 @@ namespace Sass {
     }
 
     constexpr auto url = MUNCHAR_STATIC_FUNCTION(Util::urlchars);
-    constexpr auto uri = STR("url(") ^ url ^ CHR(')');
+    constexpr auto uri = ISTR("url(") ^ url ^ CHR(')');
     constexpr auto function = ident ^ CHR('(');
 
-    constexpr auto unicode_range = STR("u+") ^
+    constexpr auto unicode_range = ISTR("u+") ^
                                    ((between(1,6,h) ^ CHR('-') ^
                                      between(1,6,h)) |
                                     range);
@@ -126,21 +124,30 @@ namespace Sass {
     constexpr auto plus    = w ^ CHR('+');
     constexpr auto greater = w ^ CHR('>');
     constexpr auto tilde   = w ^ CHR('~');
-    constexpr auto css_not = STR(":not(");
+    constexpr auto css_not = ISTR(":not(");
 
-    constexpr auto url_prefix = STR("url-prefix(") ^ w ^
+    constexpr auto url_prefix = ISTR("url-prefix(") ^ w ^
                                 (string | url) ^ w ^
                                 CHR(')');
-    constexpr auto domain     = STR("domain(") ^ w ^
+    constexpr auto domain     = ISTR("domain(") ^ w ^
                                 (string | url) ^ w ^
                                 CHR(')');
 
     constexpr auto hex_color    = CHR('#') ^ +h;
     constexpr auto interp_start = STR("#{");
+
+    MUNCHAR_DECLARE_RULE(interpolation_rule);
+    constexpr auto interpolation = interp_start ^
+                                   *(Rule<interpolation_rule, 256> { } |
+                                     string |
+                                     (!CHR('}') ^ !interp_start ^ _)) ^
+                                   CHR('}');
+    MUNCHAR_DEFINE_RULE(interpolation_rule, interpolation);
+
     constexpr auto any          = CHR(':') ^
                                   ~(CHR('-') ^ name ^ CHR('-')) ^
-                                  STR("any(");
-    constexpr auto optional     = CHR('!') ^ w ^ STR("optional");
+                                  ISTR("any(");
+    constexpr auto optional     = CHR('!') ^ w ^ ISTR("optional");
 
     constexpr auto ident_hyphen_interp = STR("-#{");
     constexpr auto string1_no_interp   = CHR('"') ^
@@ -157,6 +164,81 @@ namespace Sass {
                                          CHR('\'');
     constexpr auto string_no_interp    = string1_no_interp | string2_no_interp;
 
+    namespace Util {
+      // Decodes the contents of `string_no_interp`. CSS escapes: a backslash
+      // before a newline is a line continuation and produces nothing; one to
+      // six hex digits (plus one optional whitespace character) stand for
+      // that code point, encoded as UTF-8, with U+FFFD for zero, surrogates
+      // and values past U+10FFFF; a backslash before anything else stands for
+      // that character.
+      template<bool bounded>
+      const char* string_no_interp_value(const char* b, const char* e, char* out, size_t& n, bool& escaped) {
+        using Munchar::Tokens::Util::more;
+        const char* p = b;
+        if (!more<bounded>(p, e) || (*p != '"' && *p != '\'')) return nullptr;
+        const char stops[] = { *p, '\\', '#', '\n', '\r', '\f' };
+        const char* run = ++p;
+        char* o = out;
+        escaped = false;
+        for (;;) {
+          p = Munchar::Tokens::Util::skip_plain<bounded>(p, e, stops);
+          if (!more<bounded>(p, e) || (!bounded && *p == '\0')) return nullptr;
+          if (*p == stops[0]) {
+            if (escaped) {
+              memcpy(o, run, p-run);
+              n = o-out + (p-run);
+            }
+            else {
+              n = p-run;
+            }
+            return p+1;
+          }
+          if (*p == '#') {
+            if (more<bounded>(p+1, e) && p[1] == '{') return nullptr;
+            ++p;
+            continue;
+          }
+          if (*p != '\\') return nullptr;
+          const char* q = p+1;
+          if (!more<bounded>(q, e) || (!bounded && *q == '\0')) return nullptr;
+          escaped = true;
+          memcpy(o, run, p-run);
+          o += p-run;
+          if (*q == '\r' && more<bounded>(q+1, e) && q[1] == '\n') {
+            q += 2;
+          }
+          else if (*q == '\n' || *q == '\r' || *q == '\f') {
+            ++q;
+          }
+          else if (isxdigit(static_cast<unsigned char>(*q))) {
+            uint32_t c = 0;
+            for (int i = 0; i < 6 && more<bounded>(q, e) && isxdigit(static_cast<unsigned char>(*q)); ++i, ++q) {
+              c = c*16 + (isdigit(static_cast<unsigned char>(*q)) ? *q - '0' : (*q | 0x20) - 'a' + 10);
+            }
+            if (more<bounded>(q, e) && *q && strchr(" \t\r\n\f", *q)) ++q;
+            if (!c || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+            o = Munchar::Tokens::Util::encode_utf8(c, o);
+          }
+          else {
+            *o++ = *q++;
+          }
+          run = p = q;
+        }
+      }
+    }
+
+    // Decoding counterpart of `string_no_interp`; see string_value in
+    // munchar_strings.hpp. Since `\0` decodes to a three-byte replacement
+    // character, `out` needs room for one and a half times the literal's
+    // length.
+
+    inline const char* string_no_interp_value(const char* b, const char* e, char* out, size_t& n, bool& escaped) {
+      return Util::string_no_interp_value<true>(b, e, out, n, escaped);
+    }
+    inline const char* string_no_interp_value(const char* b, char* out, size_t& n, bool& escaped) {
+      return Util::string_no_interp_value<false>(b, nullptr, out, n, escaped);
+    }
+
     constexpr auto static_component = ident | string_no_interp | hex_color |
                                       (~CLS("+-") ^ number) | important;
     constexpr auto static_value = static_component ^
@@ -170,6 +252,46 @@ namespace Sass {
                                        (CLS(":#.") ^ nmstart)
                                      ) ^ CHR('{');
 
+    // Whole-stylesheet lexing. Scanner matches one token of [b, e) and sets
+    // its kind; whitespace and comments are tokens too, so a stylesheet is
+    // exactly the concatenation of its tokens. Anything not covered by a
+    // longer token is a one-byte DELIM, except an unmatched quote, which is
+    // an error (null).
+
+    enum Kind {
+      SPACE, COMMENT, INTERPOLATION, URI, STRING, VARIABLE, AT_KEYWORD,
+      NUMBER, FUNCTION, IDENT, HASH, IMPORTANT, OPTIONAL, CDO, CDC, MATCH,
+      DELIM
+    };
+
+    constexpr auto at_keyword = CHR('@') ^ ident;
+    constexpr auto match_op   = includes | dashmatch | prefixmatch | suffixmatch | substringmatch;
+    constexpr auto delim      = !CLS("\"'") ^ _;
+
+    struct Scanner {
+      const char* operator()(const char* b, const char* e, int& kind) const {
+        const char* p;
+        if ((p = s(b, e))) kind = SPACE;
+        else if ((p = (comment | single_line_comment)(b, e))) kind = COMMENT;
+        else if ((p = interpolation(b, e))) kind = INTERPOLATION;
+        else if ((p = uri(b, e))) kind = URI;
+        else if ((p = string(b, e))) kind = STRING;
+        else if ((p = variable(b, e))) kind = VARIABLE;
+        else if ((p = at_keyword(b, e))) kind = AT_KEYWORD;
+        else if ((p = number(b, e))) kind = NUMBER;
+        else if ((p = function(b, e))) kind = FUNCTION;
+        else if ((p = cdc(b, e))) kind = CDC;
+        else if ((p = ident(b, e))) kind = IDENT;
+        else if ((p = hash(b, e))) kind = HASH;
+        else if ((p = important(b, e))) kind = IMPORTANT;
+        else if ((p = optional(b, e))) kind = OPTIONAL;
+        else if ((p = cdo(b, e))) kind = CDO;
+        else if ((p = match_op(b, e))) kind = MATCH;
+        else if ((p = delim(b, e))) kind = DELIM;
+        return p;
+      }
+    };
+
   }
 }
 
@@ -62,6 +62,19 @@ void fail(const T& t, const char* input) {
   std::cerr << ".";
 }
 
+void check(bool ok, const std::string& what) {
+  ++TEST_NUM;
+  if (!ok) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << ": " << what << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
 int main() {
 
   pass(string_no_interp, "'hello this is a string' blah", "'hello this is a string'");
@@ -74,6 +87,83 @@ int main() {
   pass(uri, "url(http://www.foo.com/home/index.html)blah blah", "url(http://www.foo.com/home/index.html)");
   pass(uri, "url(Hey, here\\'s an obnoxious url; suck it up!.html) blah", "url(Hey, here\\'s an obnoxious url; suck it up!.html)");
 
+  pass(ident, "caf\xC3\xA9-cr\xC3\xA8me {", "caf\xC3\xA9-cr\xC3\xA8me");
+  pass(ident, "\xE6\x97\xA5\xE6\x9C\xAC: x", "\xE6\x97\xA5\xE6\x9C\xAC");
+  pass(ident, "ab\xC3(", "ab");
+  fail(ident, "\xFF" "ab");
+  fail(ident, "\xED\xA0\x80" "x");
+  pass(uri, "URL(x.png) blah", "URL(x.png)");
+  pass(important, "! IMPORTANT;", "! IMPORTANT");
+  pass(optional, "!Optional;", "!Optional");
+  pass(interpolation, "#{$a + 1} px", "#{$a + 1}");
+  pass(interpolation, "#{foo(#{$x}, '}')}bar", "#{foo(#{$x}, '}')}");
+  fail(interpolation, "#{unterminated #{inner}");
+  // The outer interpolation and 256 nested through the rule fit; one more
+  // must fail all the way up rather than match a prefix.
+  std::string deep;
+  for (int i = 0; i < 257; ++i) deep += "#{a";
+  deep += std::string(257, '}');
+  check(interpolation(deep.data(), deep.data() + deep.size()) == deep.data() + deep.size(),
+        "interpolations nested to the depth limit should match");
+  deep = "#{a" + deep + "}";
+  check(!interpolation(deep.data(), deep.data() + deep.size()),
+        "interpolations nested past the depth limit should fail");
+
+  const char* literals[][2] = {
+    { "'plain string' x", "plain string" },
+    { "\"caf\\E9  au lait\"", "caf\xC3\xA9 au lait" },
+    { "\"\\1F600\"", "\xF0\x9F\x98\x80" },
+    { "'it\\'s'", "it's" },
+    { "'line \\\ncontinued'", "line continued" },
+    { "\"#hash, not #{interp}\"", nullptr },
+    { "\"# is fine\"", "# is fine" },
+    { "'\\0'", "\xEF\xBF\xBD" }
+  };
+  for (auto& l : literals) {
+    char buf[64];
+    size_t n = 0;
+    bool escaped = true;
+    const char* in = l[0];
+    const char* end = string_no_interp_value(in, in+strlen(in), buf, n, escaped);
+    std::string got = !end ? "" : escaped ? std::string(buf, n) : std::string(in+1, n);
+    check(end == string_no_interp(in, in+strlen(in)), std::string("decoding ") + in + " should match where string_no_interp does");
+    check(end == string_no_interp_value(in, buf, n, escaped), std::string("decoding ") + in + " should match the same without an end");
+    check(l[1] ? end && got == l[1] : !end, std::string("decoding ") + in + " gave " + got);
+  }
+
+  {
+    const char* sheet = "@import 'a.css';\n$w: 10px; /* c */ .x#y > a[href^=\"#\"] {\n"
+                        "  width: calc($w + 5%); background: url(i.png) !important; // end\n"
+                        "  #{$p}-color: #fff;\n}\n<!-- -->";
+    const int expected[] = {
+      AT_KEYWORD, SPACE, STRING, DELIM, SPACE, VARIABLE, DELIM, SPACE, NUMBER, DELIM, SPACE,
+      COMMENT, SPACE, DELIM, IDENT, HASH, SPACE, DELIM, SPACE, IDENT, DELIM, IDENT, MATCH,
+      STRING, DELIM, SPACE, DELIM, SPACE, IDENT, DELIM, SPACE, FUNCTION, VARIABLE, SPACE,
+      DELIM, SPACE, NUMBER, DELIM, DELIM, SPACE, IDENT, DELIM, SPACE, URI, SPACE, IMPORTANT,
+      DELIM, SPACE, COMMENT, SPACE, INTERPOLATION, IDENT, DELIM, SPACE, HASH, DELIM, SPACE,
+      DELIM, SPACE, CDO, SPACE, CDC
+    };
+    const Scanner scan;
+    const char* e = sheet + strlen(sheet);
+    std::vector<int> kinds;
+    std::string joined;
+    const char* p = sheet;
+    while (p < e) {
+      int kind;
+      const char* q = scan(p, e, kind);
+      if (!q || q == p) break;
+      kinds.push_back(kind);
+      joined.append(p, q);
+      p = q;
+    }
+    int kind;
+    const char* open = "'open";
+    check(joined == sheet, "the stylesheet scanner should cover its input");
+    check(kinds == std::vector<int>(expected, expected + sizeof expected / sizeof *expected),
+          "the stylesheet scanner should produce the expected kinds of token");
+    check(!scan(open, open+5, kind), "the stylesheet scanner should fail on an unterminated string");
+  }
+
   if (!errors.empty()) {
     std::cerr << std::endl << TEST_NUM - COUNT << " tests failed:" << std::endl;
     for (auto &msg : errors) std::cerr << msg;
@@ -0,0 +1,126 @@
+// Tests for munchar_compressed.hpp, kept apart from test.cpp because they
+// need zlib:
+//
+//   g++ -std=c++11 -Wall -O2 -o compressed_test test/compressed_test.cpp -lz
+//
+// Add -DMUNCHAR_ZSTD and -lzstd to build the zstd reader too.
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <unistd.h>
+
+#include "../include/munchar.hpp"
+#include "../include/munchar_tokens.hpp"
+#include "../include/munchar_lexer.hpp"
+#include "../include/munchar_compressed.hpp"
+
+using namespace Munchar;
+using namespace Munchar::Tokens;
+
+size_t TEST_NUM = 0;
+size_t COUNT = 0;
+std::vector<std::string> errors;
+
+void check(bool ok, const std::string& what) {
+  ++TEST_NUM;
+  if (!ok) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << ": " << what << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+// The same small scanner as test.cpp's: kinds are 0 for whitespace, 1 for
+// comments, 2 for strings, 3 for numbers, 4 for identifiers and 5 for
+// anything else.
+struct Small_Scanner {
+  template<typename It>
+  It operator()(It b, It e, int& kind) const {
+    It p;
+    if ((p = (+ws_char)(b, e))) kind = 0;
+    else if ((p = (c_comment | cpp_comment)(b, e))) kind = 1;
+    else if ((p = Tokens::string(b, e))) kind = 2;
+    else if ((p = number(b, e))) kind = 3;
+    else if ((p = identifier(b, e))) kind = 4;
+    else if ((p = (!CLS("\"'") ^ _)(b, e))) kind = 5;
+    return p;
+  }
+};
+
+// Compresses `text` as a single gzip member.
+std::string gzip_member(const std::string& text) {
+  z_stream zs;
+  memset(std::addressof(zs), 0, sizeof zs);
+  deflateInit2(std::addressof(zs), 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(std::addressof(zs), text.size()), '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  zs.avail_in = text.size();
+  zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs.avail_out = out.size();
+  deflate(std::addressof(zs), Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(std::addressof(zs));
+  return out;
+}
+
+int main() {
+
+  std::string stream_text;
+  for (int i = 0; i < 40; ++i) {
+    stream_text += "width = 12.5e3; /* a comment */ name = \"a \\\"quoted\\\" str\" // c++\n";
+  }
+  std::vector<std::string> whole_tokens;
+  auto keep = [&](const Token& t, const char* text) { whole_tokens.push_back(std::string(text, t.length)); };
+  auto whole = stream_lexer(Small_Scanner { });
+  whole.feed(stream_text.data(), stream_text.data() + stream_text.size(), keep);
+  check(whole.finish(keep) == Stream_Lexer<Small_Scanner>::done && whole_tokens.size() == 40*16,
+        "the uncompressed input should lex");
+
+  // Two members, as concatenating gzip files produces.
+  std::string gz = gzip_member(stream_text.substr(0, 1000)) + gzip_member(stream_text.substr(1000));
+  check(gz.size() < stream_text.size() / 4, "the test input should compress");
+  auto lex_all = [&](Decompressing_Reader& in, size_t window, std::vector<std::string>& out) {
+    out.clear();
+    Stream_Lexer<Small_Scanner> lexer { Small_Scanner { } };
+    return lex_stream(in, lexer, [&](const Token& t, const char* text) {
+      out.push_back(std::string(text, t.length));
+    }, window) == Stream_Lexer<Small_Scanner>::done;
+  };
+  std::vector<std::string> gz_tokens;
+  for (size_t window : { size_t(1), size_t(13), size_t(4096) }) {
+    Decompressing_Reader in { gz.data(), gz.data() + gz.size() };
+    check(in.format() == Decompressing_Reader::gzip, "gzip input in memory should be detected");
+    check(lex_all(in, window, gz_tokens) && gz_tokens == whole_tokens,
+          "lexing gzip input through a window of " + std::to_string(window) + " should produce the uncompressed tokens");
+  }
+  int gz_pipe[2];
+  bool gz_piped = ::pipe(gz_pipe) == 0 && write(gz_pipe[1], gz.data(), gz.size()) == ssize_t(gz.size());
+  close(gz_pipe[1]);
+  {
+    Decompressing_Reader in { gz_pipe[0], 7 };
+    check(gz_piped && in.format() == Decompressing_Reader::gzip, "gzip input from a pipe should be detected");
+    check(lex_all(in, 100, gz_tokens) && gz_tokens == whole_tokens, "lexing gzip input from a pipe should produce the uncompressed tokens");
+  }
+  close(gz_pipe[0]);
+  Decompressing_Reader plain_in { stream_text.data(), stream_text.data() + stream_text.size() };
+  check(plain_in.format() == Decompressing_Reader::plain, "uncompressed input should be passed through");
+  check(lex_all(plain_in, 50, gz_tokens) && gz_tokens == whole_tokens, "lexing passed-through input should produce the same tokens");
+  Decompressing_Reader truncated { gz.data(), gz.data() + gz.size() / 3 };
+  check(!lex_all(truncated, 64, gz_tokens) && truncated.error(), "truncated gzip input should be an error");
+
+  if (!errors.empty()) {
+    std::cerr << std::endl << TEST_NUM - COUNT << " tests failed:" << std::endl;
+    for (auto &msg : errors) std::cerr << msg;
+    return 1;
+  }
+  std::cerr << std::endl << COUNT << " tests passed (that's all of them)" << std::endl;
+  return 0;
+}
@@ -4,9 +4,29 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
 
 #include "../include/munchar.hpp"
 #include "../include/munchar_tokens.hpp"
+#include "../include/munchar_literals.hpp"
+#include "../include/munchar_batch.hpp"
+#include "../include/munchar_tree.hpp"
+#include "../include/munchar_numbers.hpp"
+#include "../include/munchar_strings.hpp"
+#include "../include/munchar_intern.hpp"
+#include "../include/munchar_keywords.hpp"
+#include "../include/munchar_utf8.hpp"
+#include "../include/munchar_rope.hpp"
+#include "../include/munchar_classes.hpp"
+#include "../include/munchar_lexer.hpp"
+#include "../include/munchar_io.hpp"
+#include "../include/munchar_pipeline.hpp"
+#include "../include/munchar_parallel.hpp"
+#include "../include/munchar_token_ring.hpp"
+#include "../include/munchar_incremental.hpp"
 
 using namespace Munchar;
 using namespace Munchar::Tokens;
@@ -61,6 +81,145 @@ void fail(const T& t, const char* input) {
   std::cerr << ".";
 }
 
+template<typename T>
+void found(const T& t, const char* input, const char* result) {
+  ++TEST_NUM;
+  Match m = find(t, input);
+  Match n = find(t, input, input+strlen(input));
+  if (!m || !n || std::string(m.b, m.e-m.b) != std::string(result) ||
+      m.b != n.b || m.e != n.e) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << " should have found " << result << " in " << input << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+template<typename T>
+void not_found(const T& t, const char* input) {
+  ++TEST_NUM;
+  if (find(t, input) || find(t, input, input+strlen(input))) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << " should not have found anything in " << input << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+template<typename T>
+void rpass(const T& t, const char* input, const char* result) {
+  ++TEST_NUM;
+  const char* e = input+strlen(input);
+  const char* before = rev(t)(input, e);
+  if (!before || std::string(before, e-before) != std::string(result)) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << " should have matched backwards on " << input << ", " << result << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+template<typename T>
+void rfail(const T& t, const char* input) {
+  ++TEST_NUM;
+  if (rev(t)(input, input+strlen(input))) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << " should have failed backwards on " << input << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+void check(bool ok, const std::string& what) {
+  ++TEST_NUM;
+  if (!ok) {
+    std::stringstream msg;
+    msg << "test " << TEST_NUM << ": " << what << std::endl;
+    errors.push_back(msg.str());
+    std::cerr << "F";
+    return;
+  }
+  ++COUNT;
+  std::cerr << ".";
+}
+
+MUNCHAR_DECLARE_RULE(parens_rule);
+constexpr auto parens = left_paren ^
+                        *(Rule<parens_rule, 64> { } | (!CLS("()") ^ _)) ^
+                        right_paren;
+MUNCHAR_DEFINE_RULE(parens_rule, parens);
+
+// A context for actions: a stack of parsed values, truncated on rollback.
+struct Numbers {
+  std::vector<long> values;
+  size_t mark() const { return values.size(); }
+  void rollback(size_t m) { values.resize(m); }
+};
+
+struct Push_Number {
+  void operator()(const char* b, const char* e, Numbers& ctx) const {
+    ctx.values.push_back(std::stol(std::string(b, e-b)));
+  }
+};
+
+// A context for interning: the ids of the symbols seen, in order.
+struct Symbols {
+  std::vector<uint32_t> ids;
+  size_t mark() const { return ids.size(); }
+  void rollback(size_t m) { ids.resize(m); }
+  template<typename It>
+  void symbol(uint32_t id, It, It) { ids.push_back(id); }
+};
+
+// A small scanner for the streaming lexer: kinds are 0 for whitespace, 1
+// for comments, 2 for strings, 3 for numbers, 4 for identifiers and 5 for
+// anything else.
+struct Small_Scanner {
+  template<typename It>
+  It operator()(It b, It e, int& kind) const {
+    It p;
+    if ((p = (+ws_char)(b, e))) kind = 0;
+    else if ((p = (c_comment | cpp_comment)(b, e))) kind = 1;
+    else if ((p = Tokens::string(b, e))) kind = 2;
+    else if ((p = number(b, e))) kind = 3;
+    else if ((p = identifier(b, e))) kind = 4;
+    else if ((p = (!CLS("\"'") ^ _)(b, e))) kind = 5;
+    return p;
+  }
+};
+
+// Matches `m` over `text` cut into three segments at every pair of points,
+// and checks that it agrees with matching the contiguous text.
+template<typename M>
+bool rope_agrees(const M& m, const std::string& text) {
+  const char* b = text.data();
+  const char* e = b + text.size();
+  const char* p = m(b, e);
+  for (size_t i = 0; i <= text.size(); ++i) {
+    for (size_t j = i; j <= text.size(); ++j) {
+      Rope r;
+      r.append(b, b+i);
+      r.append(b+i, b+j);
+      r.append(b+j, e);
+      Rope::Cursor c = m(r.begin(), r.end());
+      if (bool(c) != bool(p) || (c && c.offset() != size_t(p-b))) return false;
+    }
+  }
+  return true;
+}
+
 int main() {
 
   pass(CHR('a'), "abc", "a");
@@ -227,6 +386,657 @@ int main() {
   pass(sh_comment, "# on Windows\r\nnext line", "# on Windows\r\n");
   pass(sh_comment, "# blah blah EOF", "# blah blah EOF");
 
+  found(STR("url("), "a { background: url(x.png) }", "url(");
+  found(hash ^ +hex_digit, "color: #fff; border: #00ff00", "#fff");
+  found(hash ^ (hex_digit == 6), "color: #fff; border: #00ff00", "#00ff00");
+  found(number, "width: -12.5px", "-12.5");
+  found(identifier, "  42 _foo", "_foo");
+  found(*digit, "abc", "");
+  not_found(STR("url("), "a { background: uri(x.png) }");
+  not_found(hash ^ (hex_digit == 6), "#fff #abcd");
+  not_found(CHR('a'), "");
+
+  const char* colors = "#abc, #123456 and #zz and #def";
+  std::string all;
+  size_t n = find_all(hash ^ +hex_digit, colors, colors+strlen(colors),
+                      [&](const char* b, const char* e) { all += std::string(b, e-b); });
+  check(n == 3, "find_all should have counted three colors");
+  check(all == "#abc#123456#def", "find_all should have reported the colors in order");
+  std::vector<char> digits_at_end { 'a', '1' };
+  std::string found_spans;
+  auto keep_span = [&](const char* b, const char* e) { found_spans += "[" + std::string(b, e-b) + "]"; };
+  n = find_all(*digit, digits_at_end.data(), digits_at_end.data() + digits_at_end.size(), keep_span);
+  check(n == 3 && found_spans == "[][1][]", "find_all should report and count an empty match at the end of the input");
+  found_spans.clear();
+  n = find_all(*digit, "a1", keep_span);
+  check(n == 3 && found_spans == "[][1][]", "find_all on a NUL-terminated string should count an empty match at its end");
+
+  rpass(whitespace, "trailing space \t \n", " \t \n");
+  rpass(whitespace, "none", "");
+  rpass(dot ^ +alphanumeric, "style.min.scss", ".scss");
+  rfail(dot ^ +alphanumeric, "Makefile");
+  rpass(exclamation ^ whitespace ^ STR("important"), "color: red ! important", "! important");
+  rpass(exclamation ^ (STR("important") | STR("optional")), "@extend .a !optional", "!optional");
+  rfail(exclamation ^ STR("important"), "important");
+  rfail(STR("important"), "portant");
+  rpass(number, "width: 12.5", "12.5");
+  rpass(CLS("abc") == 2, "xxcab", "ab");
+  rpass(!CHR('x') ^ +digit, "ab123", "123");
+  rfail(&CHR('x') ^ +digit, "ab123");
+  rpass(dq_string, "\"\"", "\"\"");
+  rpass(dq_string, "x \"a\"", "\"a\"");
+  rpass(dq_string, "x \"ab\"", "\"ab\"");
+  rpass(dq_string, "\"a \\\" b\"", "\"a \\\" b\"");
+  rfail(dq_string, "x\"");
+  rfail(c_comment, "/* c */");
+  auto guarded_comment = CHR('/') ^ *(!STR("*/") ^ !STR("/*") ^ _) ^ STR("*/");
+  pass(guarded_comment, "/* c */ d */", "/* c */");
+  rpass(guarded_comment, "/* c */", "/* c */");
+  rpass(guarded_comment, "/* a */ b /* c */", "/* c */");
+  rfail(guarded_comment, "/* a */ b */");
+  fail(*CHR('a') ^ CHR('a'), "aaa");
+  rfail(CHR('a') ^ *CHR('a'), "aaa");
+  pass(CHR('a') ^ *CHR('a'), "aaa", "aaa");
+  rpass(*CHR('a') ^ CHR('a'), "aaa", "aaa");
+
+  pass(parens, "(a (b) ((c) d)) e", "(a (b) ((c) d))");
+  pass(parens, "()()", "()");
+  fail(parens, "(a (b) c");
+  fail(parens, std::string(100, '(').append(100, ')').c_str());
+  pass(parens, (std::string(60, '(') + std::string(60, ')')).c_str(),
+               (std::string(60, '(') + std::string(60, ')')).c_str());
+  found(parens, "f(x, (y))", "(x, (y))");
+
+  pass(Unicode::identifier, "na\xC3\xAFve_2 = 1", "na\xC3\xAFve_2");
+  pass(Unicode::identifier, "\xCE\xB1\xCE\xB2\xCE\xB3(", "\xCE\xB1\xCE\xB2\xCE\xB3");
+  pass(Unicode::identifier, "_\xE0\xA5\xA6x", "_\xE0\xA5\xA6x");
+  fail(Unicode::identifier, "\xE0\xA5\xA6x");
+  fail(Unicode::identifier, "2x");
+  pass(+Unicode::letter, "\xD0\x96\xF0\x9D\x90\x80z1", "\xD0\x96\xF0\x9D\x90\x80z");
+  fail(Unicode::letter, "\xE2\x82\xAC");
+  pass(CP_RANGE(0x370, 0x3FF), "\xCE\xA9", "\xCE\xA9");
+  fail(CP_RANGE(0x370, 0x3FF), "\xD0\x96");
+  pass(CP(0x1F600), "\xF0\x9F\x98\x80!", "\xF0\x9F\x98\x80");
+  fail(Unicode::any, "\xC0\xAF");
+  fail(Unicode::any, "\xED\xA0\x80");
+  fail(Unicode::any, "\xF4\x90\x80\x80");
+  fail(Unicode::any, "\xE2\x82");
+  rpass(Unicode::letter ^ Unicode::letter, "1\xD0\x96\xCE\xA9", "\xD0\x96\xCE\xA9");
+  rfail(Unicode::letter, "\x96");
+  found(Unicode::letter, "12 \xE2\x82\xAC \xE6\x97\xA5", "\xE6\x97\xA5");
+
+  const Literal_Set directives { "@import", "@media", "@mixin", "@include", "@if", "@else", "@each" };
+  std::vector<std::string> prefixes;
+  for (size_t i = 0; i < 40; ++i) prefixes.push_back("-vendor" + std::to_string(i) + "-");
+  prefixes.push_back("-moz-");
+  prefixes.push_back("-webkit-");
+  prefixes.push_back("-webkit-box-");
+  const Literal_Set vendors { prefixes };
+
+  pass(directives, "@include foo;", "@include");
+  pass(directives, "@if $x", "@if");
+  fail(directives, "@i");
+  fail(directives, " @import");
+  pass(vendors, "-webkit-box-shadow", "-webkit-box-");
+  pass(vendors, "-moz-border", "-moz-");
+  fail(vendors, "-mozilla");
+
+  pass(ISTR("@media"), "@MEDIA screen", "@MEDIA");
+  pass(ISTR("!important-ness"), "!IMPORTANT-Ness", "!IMPORTANT-Ness");
+  pass(ISTR("px"), "pX;", "pX");
+  fail(ISTR("!important-ness"), "!IMPORTANT_Ness");
+  fail(ISTR("[at]"), "{AT}");
+  fail(ISTR("url("), "URL");
+  pass(ICHR('a') ^ ICLS("xyz"), "AYe", "AY");
+  fail(ICLS("xyz"), "w");
+  rpass(ISTR("Em"), "3eM", "eM");
+  found(ISTR("url("), "background: URL(x.png)", "URL(");
+
+  const Literal_Set media { { "@media", "@import", "@font-face" }, true };
+  std::vector<std::string> units;
+  for (size_t i = 0; i < 40; ++i) units.push_back("unit" + std::to_string(i));
+  units.push_back("PX");
+  const Literal_Set any_units { units, true };
+  pass(media, "@Font-Face {", "@Font-Face");
+  fail(media, "@font_face");
+  pass(any_units, "Px", "Px");
+  pass(any_units, "UNIT17;", "UNIT17");
+  found(media, "a { } @IMPORT 'x';", "@IMPORT");
+  found(any_units, "width: 12Unit3;", "Unit3");
+
+  const char* scss = "a { @include b; } @media screen { @each $x in y { @if $x {} } }";
+  std::string hits;
+  n = directives.find_all(scss, [&](size_t i, const char* b, const char* e) {
+    hits += std::to_string(i) + std::string(b, e-b);
+  });
+  check(n == 4, "fingerprint search should have counted four directives");
+  check(hits == "3@include1@media6@each4@if", "fingerprint search should have reported each directive and its index");
+
+  const char* css = "a { -webkit-box-shadow: 0; -moz-x: 1; -vendor12-y: 2; -vendor1-z }";
+  hits.clear();
+  n = vendors.find_all(css, [&](size_t i, const char* b, const char* e) {
+    hits += std::string(b, e-b);
+  });
+  check(n == 4, "automaton search should have counted four prefixes");
+  check(hits == "-webkit-box--moz--vendor12--vendor1-", "automaton search should have reported the longest prefix at each match");
+  check(vendors.find(css, css+10).b == nullptr, "automaton search should not match past the end of its range");
+
+  const char* inputs[] = { "#fff", "#12345g", "fff", "#", "", "#ABCDEF00", "x#1" };
+  std::vector<Span> spans;
+  for (const char* in : inputs) spans.push_back(Span(in, in+strlen(in)));
+  std::vector<const char*> ends;
+  auto color = hash ^ +hex_digit;
+  check(batch(color).compiled(), "a byte-class matcher should compile to a batch program");
+  check(!batch(number).compiled(), "a matcher with backtracking should fall back to scalar matching");
+  match_many(color, spans, ends);
+  for (size_t i = 0; i < spans.size(); ++i) {
+    check(ends[i] == color(spans[i].b, spans[i].e), std::string("compiled match_many should agree with the scalar matcher on ") + inputs[i]);
+  }
+  match_many(number, spans, ends);
+  for (size_t i = 0; i < spans.size(); ++i) {
+    check(ends[i] == number(spans[i].b, spans[i].e), std::string("fallback match_many should agree with the scalar matcher on ") + inputs[i]);
+  }
+
+  const char* decl = "u+00e9-00ff; width: 12px";
+  auto range = STR("u+") ^ cap<0>(+hex_digit) ^ ~(minus ^ cap<1>(+hex_digit));
+  auto unit = cap<0>(+digit) ^ ((cap<1>(STR("px") | STR("em"))) | cap<1>(percent));
+  Captures<2> caps;
+  check(range(decl, decl+strlen(decl), caps) == decl+11, "a capturing matcher should match a unicode range");
+  check(caps[0] && std::string(caps[0].b, caps[0].e) == "00e9", "the first capture should hold the range's start");
+  check(caps[1] && std::string(caps[1].b, caps[1].e) == "00ff", "the second capture should hold the range's end");
+  const char* dims = "12px";
+  Captures<2> dim;
+  check(unit(dims, dims+4, dim) == dims+4, "a capturing matcher should match a dimension");
+  check(dim[0] && std::string(dim[0].b, dim[0].e) == "12", "the first capture should hold the dimension's number");
+  check(dim[1] && std::string(dim[1].b, dim[1].e) == "px", "the second capture should hold the unit from the alternative that matched");
+  Captures<2> none;
+  const char* bare = "u+0041";
+  check(range(bare, bare+6, none) == bare+6 && !none[1], "a capture in an optional that didn't match should stay empty");
+  Captures<1> la;
+  const char* ab = "ab";
+  check((&cap<0>(CHR('a')) ^ STR("ab"))(ab, ab+2, la) && !la[0], "a capture inside a lookahead should be rolled back");
+  check(((cap<0>(CHR('a')) ^ CHR('x')) | STR("ab"))(ab, ab+2, la) && !la[0], "a capture in a failed alternative should be rolled back");
+
+  auto list = (integer >> Push_Number()) ^ *(comma ^ whitespace ^ (integer >> Push_Number()));
+  auto pair = ((integer >> Push_Number()) ^ colon ^ (integer >> Push_Number())) |
+              (integer >> Push_Number());
+  const char* nums = "1, -20, 300;";
+  const char* lone = "42;";
+  Numbers ns, ps;
+  check(list(nums, nums+strlen(nums), ns) == nums+11, "a matcher with actions should match a list");
+  check(ns.values == std::vector<long> { 1, -20, 300 }, "actions should run once per list item");
+  check(pair(lone, lone+3, ps) == lone+2, "a matcher with actions should fall back to its second alternative");
+  check(ps.values == std::vector<long> { 42 }, "actions in a failed alternative should be rolled back");
+  check(list(nums, nums+strlen(nums)) == nums+11, "a matcher with actions should match without a context");
+
+  enum { CALL, NAME, ARG };
+  auto arg = node<ARG>(number | node<NAME>(identifier));
+  auto call = node<CALL>(node<NAME>(identifier) ^ left_paren ^
+                         ~(arg ^ *(comma ^ whitespace ^ arg)) ^ right_paren);
+  auto stmt = call | node<NAME>(identifier);
+  const char* src = "rgb(10, x, 2.5)";
+  Tree tree(src);
+  bool built = stmt(src, src+strlen(src), tree) == src+strlen(src) && tree.size() == 6;
+  check(built, "building a tree should match the call and make six nodes");
+  if (built) {
+    const Node& c = tree[tree.root()];
+    const Node& f = tree[c.first_child];
+    const Node& a1 = tree[f.next_sibling];
+    const Node& a2 = tree[a1.next_sibling];
+    const Node& a3 = tree[a2.next_sibling];
+    check(c.tag == CALL && c.length == 15 && c.next_sibling == Node::none, "the root should be the whole call");
+    check(f.tag == NAME && f.begin == 0 && f.length == 3, "the call's first child should be its name");
+    check(a1.tag == ARG && a1.first_child == Node::none, "a number argument should have no children");
+    check(a2.tag == ARG && tree[a2.first_child].tag == NAME && tree[a2.first_child].begin == 8, "a name argument should have a name child");
+    check(a3.tag == ARG && a3.begin == 11 && a3.length == 3 && a3.next_sibling == Node::none, "the last argument should end the sibling list");
+  }
+  const char* word = "rgb";
+  Tree fallback(word);
+  check(stmt(word, word+3, fallback) == word+3 && fallback.size() == 1, "nodes from a failed alternative should be dropped");
+  check(fallback[fallback.root()].tag == NAME && fallback[fallback.root()].first_child == Node::none, "the fallback alternative's node should be the root");
+
+  // Values must agree bit for bit with strtod/strtoll on the matched span.
+  std::vector<std::string> corpus = {
+    "0", "-0", "+0.0", "1", "-1", "123", "12.5px", "-.333rad", ".2", "+0.002",
+    "123.", "1e10", "1.5E-7", "-123.456e-3", "123.456e+2~", "1e", "1e+", "7e22",
+    "9007199254740993", "9007199254740992e3", "0.1", "0.30000000000000004",
+    "1.7976931348623157e308", "1e309", "4.9e-324", "2.2250738585072014e-308",
+    "123456789012345678901234567890", "0.000000000000000000000000000001",
+    "3.14159265358979323846264338327950288", "1e-400", "00012.500", "99999999999999999999e-5"
+  };
+  std::mt19937 rng(1234);
+  for (int i = 0; i < 20000; ++i) {
+    std::string n = rng() % 3 ? "" : "-";
+    for (size_t k = rng() % 20; k; --k) n += char('0' + rng() % 10);
+    if (rng() % 2) {
+      n += '.';
+      for (size_t k = 1 + rng() % 20; k; --k) n += char('0' + rng() % 10);
+    }
+    if (rng() % 3 == 0) n += "e" + std::to_string(int(rng() % 700) - 350);
+    corpus.push_back(n);
+  }
+  size_t mismatches = 0;
+  for (auto& c : corpus) {
+    const char* b = c.c_str();
+    const char* e = b + c.size();
+    double v = 1, w = 1;
+    const char* p = number_value(b, e, v);
+    const char* q = number_value(b, w);
+    if (p != number(b, e) || q != number(b)) ++mismatches;
+    else if (p && (std::memcmp(&v, &w, sizeof v) ||
+                   std::strtod(std::string(b, p).c_str(), nullptr) != v ||
+                   std::signbit(v) != (c[0] == '-'))) ++mismatches;
+    double ne = 1;
+    p = number_ne_value(b, e, ne);
+    if (p != number_ne(b, e) || (p && std::strtod(std::string(b, p).c_str(), nullptr) != ne)) ++mismatches;
+    long long l = 1;
+    p = integer_value(b, e, l);
+    if (p != integer(b, e) || (p && std::strtoll(std::string(b, p).c_str(), nullptr, 10) != l)) ++mismatches;
+  }
+  check(!mismatches, std::to_string(mismatches) + " numeric values disagreed with strtod/strtoll");
+
+  char decoded[64];
+  size_t len = 0;
+  bool escaped = true;
+  const char* plain = "\"no escapes in this one\", x";
+  const char* esc = "'tab\\there \\'quoted\\' \\\\'";
+  const char* open = "\"unterminated \\\"";
+  check(string_value(plain, plain+strlen(plain), decoded, len, escaped) == plain+24, "string_value should match a plain string");
+  check(!escaped && std::string(plain+1, len) == "no escapes in this one", "string_value should not copy a string without escapes");
+  check(string_value(esc, decoded, len, escaped) == esc+strlen(esc), "string_value should match a string with escapes");
+  check(escaped && std::string(decoded, len) == "tab\there 'quoted' \\", "string_value should decode a string's escapes");
+  check(!string_value(open, open+strlen(open), decoded, len, escaped), "string_value should fail on an unterminated string");
+  check(!string_value(open, decoded, len, escaped), "string_value should fail on an unterminated string without an end");
+
+  Symbol_Table symtab;
+  Symbols syms;
+  const char* idents = "foo bar foo baz bar foo";
+  auto words = *(intern(identifier, symtab) | CHR(' '));
+  check(words(idents, idents+strlen(idents), syms) == idents+strlen(idents), "an interning matcher should match every word");
+  check(syms.ids == std::vector<uint32_t>({ 0, 1, 0, 2, 1, 0 }), "interning should give repeated words the same id");
+  check(symtab.size() == 3, "interning should store each distinct word once");
+  check(symtab.find(idents+4, idents+7) == 1, "a symbol table should find an interned word");
+  check(symtab.find(idents, idents+2) == Symbol_Table::none, "a symbol table should not find a prefix of a word");
+  check(std::string(symtab[2].b, symtab[2].e) == "baz", "a symbol table should map ids back to their spelling");
+  bool interned = true;
+  for (int i = 0; i < 5000; ++i) interned &= symtab.intern(std::to_string(i).c_str()) == uint32_t(i+3);
+  check(interned, "interning through table growth should assign dense ids");
+  for (int i = 0; i < 5000; ++i) interned &= symtab.intern(std::to_string(i).c_str()) == uint32_t(i+3);
+  check(interned, "interning again after growth should return the same ids");
+
+  Concurrent_Symbol_Table shared;
+  std::vector<std::vector<uint32_t>> seen(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&shared, &seen, t] {
+      for (int i = 0; i < 3000; ++i) {
+        std::string s = "sym" + std::to_string((i * (t+1)) % 3000);
+        seen[t].push_back(shared.intern(s.data(), s.data()+s.size()));
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  check(shared.size() == 3000, "threads sharing a symbol table should intern each word once");
+  bool agreed = true;
+  std::vector<bool> used(3000, false);
+  for (int t = 0; t < 4; ++t) {
+    for (int i = 0; i < 3000; ++i) {
+      uint32_t id = seen[t][i];
+      std::string s = "sym" + std::to_string((i * (t+1)) % 3000);
+      agreed &= id < 3000 && std::string(shared[id].b, shared[id].e) == s &&
+                shared.find(s.data(), s.data()+s.size()) == id;
+      if (id < 3000) used[id] = true;
+    }
+  }
+  check(agreed, "threads sharing a symbol table should agree on each word's id");
+  bool dense = true;
+  for (bool u : used) dense &= u;
+  check(dense, "threads sharing a symbol table should get dense ids");
+
+  const Keyword_Table kwds { { "if", 1 }, { "else", 2 }, { "while", 3 }, { "if", 4 }, { "", 5 } };
+  int kind = 0;
+  const char* kw_src = "while(x) elsewhere if:";
+  check(kwds.scan(identifier, kw_src, kind) == kw_src+5 && kind == 3, "a keyword table should classify a keyword");
+  check(kwds.scan(identifier, kw_src+9, kind) == kw_src+18 && kind == Keyword_Table::none, "a keyword table should not classify a word a keyword starts");
+  check(kwds.scan(identifier, kw_src+19, kind) == kw_src+21 && kind == 1, "a keyword table should keep the first of duplicate keywords");
+  check(kwds.scan(identifier, colon, kw_src+19, kind) == kw_src+21 && kind == Keyword_Table::none, "a keyword followed by its boundary should not be classified");
+  check(!kwds.scan(identifier, kw_src+5, kind), "a keyword table should fail where the word matcher fails");
+  std::vector<std::string> spellings;
+  std::vector<Keyword> many;
+  for (int i = 0; i < 500; ++i) {
+    spellings.push_back((i % 3 ? "kw" : "a_rather_long_keyword_") + std::to_string(i));
+  }
+  for (int i = 0; i < 500; ++i) many.push_back(Keyword { spellings[i].c_str(), i });
+  const Keyword_Table big(many);
+  bool exact = true, longer = true, shorter = true;
+  for (int i = 0; i < 500; ++i) {
+    const std::string& w = spellings[i];
+    std::string near = w + "x";
+    exact &= big.classify(w.data(), w.data()+w.size()) == i;
+    longer &= big.classify(near.data(), near.data()+near.size()) == Keyword_Table::none;
+    shorter &= big.classify(w.data(), w.data()+w.size()-1) != i;
+  }
+  check(exact, "a large keyword table should classify each of its keywords");
+  check(longer, "a large keyword table should not classify a keyword with a byte added");
+  check(shorter, "a large keyword table should not classify a keyword with a byte removed");
+
+  const char* ascii_text = "plain old ASCII, long enough for the word-at-a-time path";
+  const char* utf8_text = "na\xC3\xAFve \xE6\x97\xA5\xE6\x9C\xAC \xF0\x9F\x98\x80 ok";
+  const char* bad_text = "fine so far... \xE6\x97 oops";
+  Utf8_Status plain_st = check_utf8(ascii_text), utf8_st = check_utf8(utf8_text), bad_st = check_utf8(bad_text);
+  check(plain_st.valid && plain_st.ascii && !plain_st.error, "ASCII text should validate as ASCII");
+  check(utf8_st.valid && !utf8_st.ascii, "multibyte text should validate as UTF-8 but not ASCII");
+  check(!bad_st.valid && bad_st.error == bad_text+15, "a truncated sequence should be reported where it starts");
+  // Compare against decoding one codepoint at a time.
+  std::mt19937 utf8_rng(7);
+  const unsigned char interesting[] = { 'a', 0x00, 0x7F, 0x80, 0x8F, 0x90, 0xBF, 0xC0, 0xC2, 0xDF, 0xE0,
+                                        0xE1, 0xED, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5, 0xFF, 0xA0, 0x9F };
+  bool validated = true;
+  for (int t = 0; t < 20000 && validated; ++t) {
+    std::string buf(utf8_rng() % 40, 'x');
+    for (auto& c : buf) if (utf8_rng() % 4 == 0) c = interesting[utf8_rng() % sizeof interesting];
+    const char* b = buf.data();
+    const char* e = b + buf.size();
+    const char* p = b;
+    bool ascii = true;
+    for (uint32_t cp; p < e && Munchar::Util::decode_utf8(p, e, cp); ascii &= cp < 0x80) p = Munchar::Util::decode_utf8(p, e, cp);
+    Utf8_Status st = check_utf8(b, e);
+    validated = st.valid == (p == e) && (!st.valid || st.ascii == ascii) && (st.valid || st.error == p);
+  }
+  check(validated, "UTF-8 validation should agree with decoding");
+
+  // The same matchers over UTF-16 and UTF-32 input.
+  const char16_t* wide16 = u"Select (a (b)) \U0001D400x\u00E9 42";
+  const char32_t* wide32 = U"Select (a (b)) \U0001D400x\u00E9 42";
+  auto wide_word = ISTR("select") ^ CHR(' ');
+  auto wide_digits = +CLS("0123456789");
+  auto wide_ident = Munchar::Unicode::identifier;
+  check(wide_word(wide16) == wide16+7 && wide_word(wide32) == wide32+7, "case-insensitive strings should match wide input");
+  check(parens(wide16+7) == wide16+14 && parens(wide32+7, wide32+14) == wide32+14, "recursive rules should match wide input");
+  check(wide_ident(wide16+15) == wide16+19, "a UTF-16 identifier should take a surrogate pair as one letter");
+  check(wide_ident(wide32+15) == wide32+18, "a UTF-32 identifier should take a codepoint as one letter");
+  check(!wide_ident(u"\xD83D", u"\xD83D"+1), "a lone surrogate should not match");
+  check((STR("Sel") ^ ~CHR('x'))(wide16) == wide16+3, "strings and optionals should match UTF-16 input");
+  check(wide_digits.reverse(wide32, wide32+std::char_traits<char32_t>::length(wide32)) == wide32+19, "matching backwards should work on UTF-32 input");
+  Basic_Match<char16_t> wide_num = find(wide_digits, wide16);
+  Basic_Match<char32_t> wide_e = find(CP(0xE9), wide32, wide32+21);
+  check(wide_num.b == wide16+20 && wide_num.e == wide16+22, "find should locate digits in UTF-16 input");
+  check(wide_e.b == wide32+17, "find should locate a codepoint in UTF-32 input");
+  check(!find(CHR('#'), wide32), "find should fail on UTF-32 input without a match");
+  // Byte predicates reject wide units instead of passing them to <cctype>.
+  const char32_t* beyond = U"x\U0010FFFFy";
+  check(identifier(beyond, beyond+3) == beyond+1, "an identifier should stop at a unit above 0xFF");
+  check(!identifier(beyond+1), "an identifier should not start with a unit above 0xFF");
+  check(!letter(u"\uFFFF"), "a byte predicate should reject a UTF-16 unit above 0xFF");
+  check(!digit(U"\u0661", U"\u0661"+1), "a byte predicate should reject an Arabic-Indic digit");
+  check(!ws_char.reverse(U"\u3000", U"\u3000"+1), "a byte predicate should reject an ideographic space backwards");
+  check(!P(::isalpha)(U"\u0141"), "a dynamic predicate should reject a unit above 0xFF");
+  check(P(::isalpha)(U"\u0041") && !P(::isalpha)(U"\u0100"), "a dynamic predicate should only take units of 0xFF or below as bytes");
+  const Unit_Class cjk { { 0x4E00, 0x9FFF }, { 0xFF01, 0xFF5E }, { '_', '_' }, { 0x3400, 0x4DBF }, { 0x4DC0, 0x4DC0 } };
+  const char32_t* han = U"\u4E2D\u6587_\uFF21\u3000";
+  check((+cjk)(han, han+5) == han+4, "a unit class should match units from each of its ranges");
+  check(cjk(U"\u4DC0") && !cjk(U"\u4DC1") && cjk(U"\u3400") && !cjk(U"\u33FF"), "a unit class should merge adjacent ranges and keep their ends");
+  check(cjk.reverse(han, han+4) == han+3 && !cjk.reverse(han, han+5), "a unit class should match backwards");
+  const char16_t* mixed = u"abc \u6587_";
+  check(find(cjk, mixed).b == mixed+4, "find should locate a unit class's wide members");
+  const Unit_Class greek { u"\u03B1\u03B2\u03B3_" };
+  const char16_t* alpha = u"\u03B3_\u03B1z";
+  const char* narrow = "__\xB1";
+  check((+greek)(alpha) == alpha+3, "a unit class built from a string should match its units");
+  check((+greek)(narrow) == narrow+2, "a unit class should match char input by byte value, unaffected by its wide members");
+
+  const std::string rope_text = "(a (b) ((c) d)) na\xC3\xAFve /* x */ abd";
+  auto rope_comment = STR("/*") ^ *(!STR("*/") ^ _) ^ STR("*/");
+  auto rope_backtrack = (STR("abc") | CHR('a')) ^ STR("bd");
+  check(rope_agrees(parens, rope_text), "a recursive rule should match a rope as contiguous input");
+  check(rope_agrees(*(parens | _), rope_text), "a repetition should match a rope as contiguous input");
+  check(rope_agrees(Munchar::Unicode::identifier, rope_text.substr(16)), "decoding UTF-8 across segments should match contiguous input");
+  check(rope_agrees(rope_comment, rope_text.substr(23)), "a negative lookahead should match a rope as contiguous input");
+  check(rope_agrees(rope_backtrack, rope_text.substr(31)), "backtracking across segments should match contiguous input");
+  check(rope_agrees(ISTR("(A (B) ((C") ^ (ICLS(")x") >= 1), rope_text), "case-insensitive matchers should match a rope as contiguous input");
+  check(rope_agrees(rev(STR("*/ ") ^ rope_backtrack), rope_text), "matching a rope backwards should agree with contiguous input");
+  check(rope_agrees(rev(+Munchar::Unicode::letter), rope_text.substr(0, 22)), "decoding UTF-8 backwards across segments should agree with contiguous input");
+  Rope rope;
+  rope.append("(a (b");
+  rope.append(") c)");
+  rope.append(" naïve");
+  Rope::Cursor rope_end = parens(rope.begin());
+  check(rope_end.offset() == 9 && rope.str(rope.begin(), rope_end) == "(a (b) c)", "a rule should match across rope segments");
+  check(rope.at(7) - rope.at(2) == 5, "rope cursors should subtract to their distance");
+  check(*rope.at(5) == ')' && rope.at(5)[-1] == 'b', "rope cursors should index across segments");
+  check(Munchar::Unicode::identifier(rope.at(10)) == rope.end(), "a matcher should reach the end of a rope");
+  auto rope_call = left_paren ^ cap<0>(identifier) ^ whitespace ^ cap<1>(parens);
+  auto rope_nodes = left_paren ^ node<NAME>(identifier) ^ whitespace ^ node<ARG>(parens);
+  Captures<2, Rope::Cursor> rope_caps;
+  check(rope_call(rope.begin(), rope.end(), rope_caps) == rope.at(6), "a capturing matcher should match a rope");
+  check(rope_caps[0] && rope.str(rope_caps[0].b, rope_caps[0].e) == "a", "a capture over a rope should hold its span");
+  check(rope_caps[1] && rope.str(rope_caps[1].b, rope_caps[1].e) == "(b)", "a capture over a rope should span segments");
+  Basic_Tree<Rope::Cursor> rope_tree(rope.begin());
+  check(rope_nodes(rope.begin(), rope.end(), rope_tree) == rope.at(6) && rope_tree.size() == 2, "building a tree over a rope should make a node per match");
+  check(rope_tree[rope_tree.root()].tag == NAME && rope_tree[rope_tree.root()].begin == 1, "a tree over a rope should measure offsets from its base");
+  check(rope_tree[rope_tree[rope_tree.root()].next_sibling].length == 3, "a node spanning rope segments should have the span's length");
+  Rope rope_words;
+  rope_words.append("fo");
+  rope_words.append("o b");
+  rope_words.append("ar");
+  Symbols rope_syms;
+  check(words(rope_words.begin(), rope_words.end(), rope_syms) == rope_words.end(), "an interning matcher should match a rope");
+  check(rope_syms.ids == std::vector<uint32_t>({ 0, 1 }), "interning across rope segments should find the words' ids");
+
+  std::string stream_text;
+  for (int i = 0; i < 40; ++i) {
+    stream_text += "width = 12.5e3; /* a comment */ name = \"a \\\"quoted\\\" str\" // c++\n";
+  }
+  std::vector<std::string> whole_tokens, chunked_tokens;
+  std::vector<Token> whole_spans, chunked_spans;
+  auto whole = stream_lexer(Small_Scanner { });
+  check(whole.feed(stream_text.data(), stream_text.data() + stream_text.size(), [&](const Token& t, const char* text) {
+    whole_tokens.push_back(std::string(text, t.length));
+    whole_spans.push_back(t);
+  }) == Stream_Lexer<Small_Scanner>::need_more, "a stream lexer should ask for more input until finished");
+  check(whole.finish([&](const Token& t, const char* text) {
+    whole_tokens.push_back(std::string(text, t.length));
+    whole_spans.push_back(t);
+  }) == Stream_Lexer<Small_Scanner>::done && whole.pending() == 0, "finishing a stream lexer should flush its last token");
+  check(whole_tokens.size() == 40*16 && whole_tokens[4] == "12.5e3", "a stream lexer should produce every token");
+  for (size_t chunk = 1; chunk < 70; chunk += 3) {
+    chunked_tokens.clear();
+    chunked_spans.clear();
+    auto keep = [&](const Token& t, const char* text) {
+      chunked_tokens.push_back(std::string(text, t.length));
+      chunked_spans.push_back(t);
+    };
+    Stream_Lexer<Small_Scanner> lexer { Small_Scanner { } };
+    bool fed = true;
+    for (size_t i = 0; i < stream_text.size() && fed; i += chunk) {
+      size_t n = std::min(chunk, stream_text.size() - i);
+      fed = lexer.feed(stream_text.data() + i, stream_text.data() + i + n, keep) == Stream_Lexer<Small_Scanner>::need_more &&
+            lexer.pending() < 40;
+    }
+    bool same = fed && lexer.finish(keep) == Stream_Lexer<Small_Scanner>::done &&
+                chunked_tokens == whole_tokens && chunked_spans.size() == whole_spans.size();
+    for (size_t i = 0; i < chunked_spans.size() && same; ++i) {
+      same = chunked_spans[i].kind == whole_spans[i].kind && chunked_spans[i].offset == whole_spans[i].offset;
+    }
+    check(same, "lexing in chunks of " + std::to_string(chunk) + " should produce the same tokens as lexing at once");
+  }
+  auto ignore = [](const Token&, const char*) { };
+  Stream_Lexer<Small_Scanner> unterminated { Small_Scanner { }, 64 };
+  check(unterminated.feed(stream_text.data(), stream_text.data() + 10, ignore) == Stream_Lexer<Small_Scanner>::need_more &&
+        unterminated.feed("\"never closed", "\"never closed" + 13, ignore) == Stream_Lexer<Small_Scanner>::need_more,
+        "a stream lexer should wait for the end of an open string");
+  check(unterminated.finish(ignore) == Stream_Lexer<Small_Scanner>::error && unterminated.offset() == 10,
+        "a string still open at the end of the stream should be an error where it starts");
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  for (size_t n : { size_t(0), size_t(1), page-100, page-1, page, page+1, 2*page }) {
+    char path[] = "/tmp/munchar_io_XXXXXX";
+    int fd = mkstemp(path);
+    std::string bytes(n, 'x');
+    for (size_t i = 0; i < n; ++i) bytes[i] = char('a' + i % 26);
+    bool written = fd >= 0 && write(fd, bytes.data(), n) == ssize_t(n);
+    close(fd);
+    Input_Buffer in = load_file(path);
+    unlink(path);
+    std::string size = std::to_string(n);
+    check(written && in.ok() && in.size() == n && in.mapped() == (n > 0), "a file of " + size + " bytes should load, mapped unless empty");
+    check(!memcmp(in.data(), bytes.data(), n), "a file of " + size + " bytes should load with its contents");
+    bool padded = true;
+    for (size_t i = 0; i < Input_Buffer::default_padding && padded; ++i) padded = in.end()[i] == '\0';
+    check(padded, "a file of " + size + " bytes should be followed by zero padding");
+  }
+  int io_pipe[2];
+  bool piped_ok = ::pipe(io_pipe) == 0 && write(io_pipe[1], "piped input", 11) == 11;
+  close(io_pipe[1]);
+  Input_Buffer piped = load_fd(io_pipe[0], 8);
+  close(io_pipe[0]);
+  check(piped_ok && piped.ok() && !piped.mapped() && std::string(piped.data()) == "piped input",
+        "a pipe should be read in pieces and followed by zero padding");
+  Input_Buffer missing = load_file("/nonexistent/munchar");
+  check(!missing.ok() && missing.error() == ENOENT && !missing.data(), "a missing file should report its error");
+
+  std::vector<std::string> batch_paths, batch_contents;
+  std::mt19937 batch_rng(45);
+  bool batch_written = true;
+  for (size_t i = 0; i < 25; ++i) {
+    char path[] = "/tmp/munchar_batch_XXXXXX";
+    int fd = mkstemp(path);
+    size_t n = i == 0 ? 0 : i == 1 ? page : batch_rng() % 20000;
+    std::string bytes(n, ' ');
+    for (auto& c : bytes) c = char('a' + batch_rng() % 26);
+    batch_written = batch_written && fd >= 0 && write(fd, bytes.data(), n) == ssize_t(n);
+    close(fd);
+    batch_paths.push_back(path);
+    batch_contents.push_back(bytes);
+  }
+  batch_paths.push_back("/nonexistent/munchar");
+  check(batch_written, "the read pipeline's test files should be written");
+  for (bool uring : { true, false }) {
+    Read_Pipeline pipeline { 4, 16, uring };
+    std::mutex seen_lock;
+    std::vector<int> seen(batch_paths.size(), 0);
+    pipeline.run(batch_paths, 3, [&](const Loaded_File& f) {
+      bool good = f.index + 1 < batch_paths.size()
+                ? f.data && !f.error && std::string(f.data, f.size) == batch_contents[f.index] &&
+                  !memcmp(f.data + f.size, std::string(16, '\0').data(), 16)
+                : !f.data && f.error == ENOENT;
+      std::lock_guard<std::mutex> g(seen_lock);
+      seen[f.index] += good ? 1 : 100;
+    });
+    bool once = true;
+    for (int k : seen) once = once && k == 1;
+    std::string how = uring ? " with io_uring allowed" : " with pread";
+    check(once, "the read pipeline should deliver every file once, padded," + how);
+    check(uring || !pipeline.uses_io_uring(), "the read pipeline should not use io_uring when told not to");
+  }
+  for (size_t i = 0; i + 1 < batch_paths.size(); ++i) unlink(batch_paths[i].c_str());
+
+  // Long comments and strings spanning lines put some split points inside
+  // them, so some chunks are guessed wrong.
+  std::string par_text;
+  for (int i = 0; i < 300; ++i) {
+    par_text += stream_text.substr(0, 200 + i % 70);
+    par_text += i % 7 ? "\n/* spans\n\"lines\n */ x = \"a\\\n\" ;\n" : "\n/*\n/* \" */\n";
+  }
+  std::vector<Token> par_whole;
+  auto par_collect = [&](const Token& t, const char*) { par_whole.push_back(t); };
+  Stream_Lexer<Small_Scanner> par_ref { Small_Scanner { } };
+  check(par_ref.feed(par_text.data(), par_text.data() + par_text.size(), par_collect) == Stream_Lexer<Small_Scanner>::need_more &&
+        par_ref.finish(par_collect) == Stream_Lexer<Small_Scanner>::done, "the parallel lexer's reference input should lex");
+  bool par_relexed = false;
+  for (size_t threads : { 1, 2, 3, 8, 64 }) {
+    std::vector<Token> toks;
+    auto lexer = parallel_lexer(Small_Scanner { }, threads, 100);
+    std::string on = " on " + std::to_string(threads) + " threads";
+    check(lexer.lex(par_text.data(), par_text.data() + par_text.size(), toks) && lexer.offset() == par_text.size(),
+          "lexing in parallel" + on + " should lex the whole input");
+    bool same = toks.size() == par_whole.size();
+    for (size_t i = 0; i < toks.size() && same; ++i) {
+      same = toks[i].kind == par_whole[i].kind && toks[i].offset == par_whole[i].offset && toks[i].length == par_whole[i].length;
+    }
+    check(same, "lexing in parallel" + on + " should produce the same tokens as lexing on one thread");
+    par_relexed = par_relexed || lexer.relexed() > 0;
+  }
+  check(par_relexed, "some chunk of the parallel lexer's input should be guessed wrong");
+  std::string par_bad = par_text + "\n\"unterminated";
+  for (int i = 0; i < 500; ++i) par_bad += "x = 1;\n";
+  std::vector<Token> bad_toks;
+  size_t bad_count = 0;
+  auto bad_collect = [&](const Token&, const char*) { ++bad_count; };
+  Stream_Lexer<Small_Scanner> bad_ref { Small_Scanner { } };
+  bad_ref.feed(par_bad.data(), par_bad.data() + par_bad.size(), bad_collect);
+  auto bad_lexer = parallel_lexer(Small_Scanner { }, 8, 100);
+  check(bad_ref.finish(bad_collect) == Stream_Lexer<Small_Scanner>::error, "the parallel lexer's bad input should not lex");
+  check(!bad_lexer.lex(par_bad.data(), par_bad.data() + par_bad.size(), bad_toks) && bad_lexer.offset() == bad_ref.offset(),
+        "lexing in parallel should find an error where lexing on one thread does");
+  check(bad_toks.size() == bad_count && bad_count > par_whole.size() / 2, "lexing in parallel should keep the tokens before an error");
+
+  const char* ring_b = par_text.data();
+  const char* ring_e = ring_b + par_text.size();
+  size_t ring_stop = 0;
+  for (size_t capacity : { size_t(1), size_t(40), size_t(4096) }) {
+    std::vector<Token> got;
+    std::string through = " through a ring of " + std::to_string(capacity);
+    check(lex_pipelined(Small_Scanner { }, ring_b, ring_e, [&](Token_Ring& ring) {
+      Token t;
+      while (ring.next(t)) got.push_back(t);
+      return ring.capacity() >= 2*Token_Ring::batch;
+    }, ring_stop, capacity) && ring_stop == par_text.size(), "lexing" + through + " should lex the whole input");
+    bool same = got.size() == par_whole.size();
+    for (size_t i = 0; i < got.size() && same; ++i) {
+      same = got[i].kind == par_whole[i].kind && got[i].offset == par_whole[i].offset && got[i].length == par_whole[i].length;
+    }
+    check(same, "tokens passed" + through + " should arrive complete and in order");
+  }
+  // A parser that gives up while the lexer is blocked on a full ring.
+  size_t taken = 0;
+  check(!lex_pipelined(Small_Scanner { }, ring_b, ring_e, [&](Token_Ring& ring) {
+    Token t;
+    while (taken < 10 && ring.next(t)) ++taken;
+    return true;
+  }, ring_stop, 16) && taken == 10 && ring_stop < par_text.size(), "a parser giving up should release a lexer waiting on a full ring");
+  size_t bad_taken = 0;
+  check(!lex_pipelined(Small_Scanner { }, par_bad.data(), par_bad.data() + par_bad.size(), [&](Token_Ring& ring) {
+    Token t;
+    while (ring.next(t)) ++bad_taken;
+    return true;
+  }, ring_stop) && ring_stop == bad_ref.offset() && bad_taken == bad_count, "a lexing error should end the ring after the tokens before it");
+
+  // Random edits, some of which open or close comments and strings or
+  // extend numbers through their exponents, checked against lexing the
+  // edited text from scratch.
+  std::string doc = stream_text.substr(0, 3 * stream_text.size() / 40);
+  auto inc = incremental_lexer(Small_Scanner { });
+  check(inc.lex(doc.data(), doc.data() + doc.size()) && inc.tokens().size() == 3*16, "an incremental lexer should lex a whole document");
+  const char* snippets[] = { "x", "12", "e", "+", "5", " ", "\n", "\"", "/*", "*/", "//", "\\", "ab c", ".5e" };
+  std::mt19937 inc_rng(50);
+  bool inc_ok = true;
+  for (int i = 0; i < 2000 && inc_ok; ++i) {
+    size_t o = inc_rng() % (doc.size() + 1);
+    size_t removed = inc_rng() % 3 ? 0 : std::min(size_t(inc_rng() % 6), doc.size() - o);
+    std::string ins = inc_rng() % 4 ? snippets[inc_rng() % (sizeof snippets / sizeof *snippets)] : "";
+    doc.replace(o, removed, ins);
+    bool lexed = inc.edit(doc.data(), doc.data() + doc.size(), Edit { o, removed, ins.size() });
+    auto fresh = incremental_lexer(Small_Scanner { });
+    inc_ok = fresh.lex(doc.data(), doc.data() + doc.size()) == lexed && fresh.offset() == inc.offset() &&
+             fresh.tokens().size() == inc.tokens().size();
+    for (size_t k = 0; k < fresh.tokens().size() && inc_ok; ++k) {
+      const Token& a = fresh.tokens()[k];
+      const Token& c = inc.tokens()[k];
+      inc_ok = a.kind == c.kind && a.offset == c.offset && a.length == c.length;
+    }
+  }
+  check(inc_ok, "relexing after random edits should agree with lexing the edited text");
+  // Typing inside an identifier in a long document relexes only around it.
+  std::string big_doc = par_text;
+  check(inc.lex(big_doc.data(), big_doc.data() + big_doc.size()), "an incremental lexer should lex a long document");
+  size_t mid = big_doc.find("name", big_doc.size() / 2) + 2;
+  big_doc.insert(mid, "q");
+  check(inc.edit(big_doc.data(), big_doc.data() + big_doc.size(), Edit { mid, 0, 1 }), "a long document should still lex after an edit");
+  check(inc.relexed() < 20, "an edit inside an identifier should relex only around it");
+  check(inc.replaced() == 1 && inc.inserted() == 1, "an edit inside an identifier should replace only that token");
+  check(inc.tokens()[inc.first()].length == 5 && inc.tokens()[inc.first()].offset == mid - 2, "the replaced token should span the edited identifier");
+
   if (!errors.empty()) {
     std::cerr << std::endl << TEST_NUM - COUNT << " tests failed:" << std::endl;
     for (auto &msg : errors) std::cerr << msg;
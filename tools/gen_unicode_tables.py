@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Generates include/munchar_unicode_tables.hpp from the Unicode database
+# bundled with Python (unicodedata). XID_Start and XID_Continue are taken
+# from str.isidentifier, which follows UAX #31.
+#
+#   python3 tools/gen_unicode_tables.py [output]
+
+import sys
+import unicodedata
+
+
+def xid_start(ch):
+    return ch != '_' and ch.isidentifier()
+
+
+def xid_continue(ch):
+    return ('a' + ch).isidentifier()
+
+
+def letter(ch):
+    return unicodedata.category(ch).startswith('L')
+
+
+PROPERTIES = [('xid_start', xid_start),
+              ('xid_continue', xid_continue),
+              ('letter', letter)]
+
+
+def build():
+    # Blocks of 256 codepoints are shared between properties and positions.
+    empty = bytes(32)
+    pool = [empty]
+    index = {empty: 0}
+    stage1 = {}
+    for name, has in PROPERTIES:
+        row = []
+        for hi in range(0x1100):
+            bits = bytearray(32)
+            for lo in range(256):
+                c = hi*256 + lo
+                if 0xD800 <= c <= 0xDFFF:
+                    continue
+                if has(chr(c)):
+                    bits[lo >> 3] |= 1 << (lo & 7)
+            block = bytes(bits)
+            if block not in index:
+                index[block] = len(pool)
+                pool.append(block)
+            row.append(index[block])
+        stage1[name] = row
+    assert len(pool) <= 256
+    return pool, stage1
+
+
+def emit(pool, stage1):
+    out = ['''#ifndef MUNCHAR_UNICODE_TABLES
+#define MUNCHAR_UNICODE_TABLES
+
+// Generated from the Unicode Character Database (version %s) by
+// tools/gen_unicode_tables.py; do not edit.
+
+#include <cstdint>
+
+namespace Munchar {
+  namespace Unicode {
+    namespace Tables {
+
+      // 256-codepoint blocks, one bit per codepoint.
+      constexpr uint8_t blocks[][32] = {
+''' % unicodedata.unidata_version]
+    for block in pool:
+        out.append('        { ' + ', '.join('0x%02X' % x for x in block) + ' },\n')
+    out.append('      };\n')
+    for name, _ in PROPERTIES:
+        row = stage1[name]
+        out.append('\n      // Block for each 256 codepoints, U+0000 to U+10FFFF.\n')
+        out.append('      constexpr uint8_t %s[] = {\n' % name)
+        for i in range(0, len(row), 16):
+            out.append('        ' + ', '.join(str(x) for x in row[i:i+16]) + ',\n')
+        out.append('      };\n')
+    out.append('''
+    }
+  }
+}
+
+#endif
+''')
+    return ''.join(out)
+
+
+if __name__ == '__main__':
+    path = sys.argv[1] if len(sys.argv) > 1 else 'include/munchar_unicode_tables.hpp'
+    with open(path, 'w') as f:
+        f.write(emit(*build()))
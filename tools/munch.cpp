@@ -0,0 +1,266 @@
+// munch: lexes many files at once and reports how fast.
+//
+//   munch [-j threads] [-n slowest] path...
+//
+// Each path is a file, a directory (searched recursively) or a glob pattern
+// (expanded here, so it can be quoted to get past the shell's argument
+// limit). The grammar is chosen by extension: .ts files are lexed as
+// Tritium, .scss and .css files as SCSS; other files found in directories
+// are ignored. Files are mapped rather than read, and scheduled on a
+// work-stealing pool: each thread starts with its share of the files, the
+// largest first, and takes from the others' shares once its own runs out.
+// Each thread lexes into one token buffer that it reuses for every file.
+//
+// Build: g++ -std=c++11 -O2 -pthread -o munch tools/munch.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/munchar_io.hpp"
+#include "../include/munchar_lexer.hpp"
+#include "../examples/tritium_tokens.hpp"
+#include "../scss/scss_tokens.hpp"
+
+using Munchar::Token;
+
+enum Grammar { none, tritium, scss };
+
+struct Source {
+  std::string path;
+  Grammar grammar;
+  size_t size;
+};
+
+struct Result {
+  size_t file;
+  double usec;
+  size_t bytes;
+  size_t tokens;
+  std::string error;      // empty when the file lexed
+};
+
+Grammar grammar_for(const std::string& path) {
+  size_t dot = path.rfind('.');
+  if (dot == std::string::npos || path.find('/', dot) != std::string::npos) return none;
+  std::string ext = path.substr(dot+1);
+  if (ext == "ts") return tritium;
+  if (ext == "scss" || ext == "css") return scss;
+  return none;
+}
+
+// Adds `path` and, for a directory, everything under it with a known
+// extension; a file named outright must have one.
+void collect(const std::string& path, bool named, std::vector<Source>& out, std::vector<std::string>& problems) {
+  struct stat st;
+  if (stat(path.c_str(), std::addressof(st)) != 0) {
+    problems.push_back(path + ": " + strerror(errno));
+    return;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    DIR* d = opendir(path.c_str());
+    if (!d) {
+      problems.push_back(path + ": " + strerror(errno));
+      return;
+    }
+    std::vector<std::string> names;
+    while (dirent* ent = readdir(d)) {
+      if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) names.push_back(ent->d_name);
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    std::string dir = path.back() == '/' ? path : path + "/";
+    for (auto& n : names) collect(dir + n, false, out, problems);
+    return;
+  }
+  Grammar g = grammar_for(path);
+  if (g != none && S_ISREG(st.st_mode)) out.push_back(Source { path, g, size_t(st.st_size) });
+  else if (named) problems.push_back(path + ": no grammar for this file");
+}
+
+// Lexes [b, e) into `tokens`; on an error, `stop` is where the bad token
+// starts.
+template<typename S>
+bool lex(const S& scan, const char* b, const char* e, std::vector<Token>& tokens, size_t& stop) {
+  const char* p = b;
+  while (p < e) {
+    int kind;
+    const char* q = scan(p, e, kind);
+    if (!q || q == p) break;
+    tokens.push_back(Token { kind, size_t(p-b), size_t(q-p) });
+    p = q;
+  }
+  stop = p-b;
+  return p == e;
+}
+
+// One thread's share of the files: the owner takes from the back, thieves
+// from the front.
+class Work_Queue {
+  std::mutex lock_;
+  std::deque<size_t> files_;
+public:
+  void push(size_t f) {
+    std::lock_guard<std::mutex> g(lock_);
+    files_.push_back(f);
+  }
+  bool pop(size_t& f) {
+    std::lock_guard<std::mutex> g(lock_);
+    if (files_.empty()) return false;
+    f = files_.back();
+    files_.pop_back();
+    return true;
+  }
+  bool steal(size_t& f) {
+    std::lock_guard<std::mutex> g(lock_);
+    if (files_.empty()) return false;
+    f = files_.front();
+    files_.pop_front();
+    return true;
+  }
+};
+
+struct Worker {
+  std::vector<Token> tokens;    // reused for every file
+  std::vector<Result> results;
+};
+
+Result munch(const Source& src, size_t file, std::vector<Token>& tokens) {
+  auto t0 = std::chrono::steady_clock::now();
+  Result r { file, 0, 0, 0, std::string() };
+  Munchar::Input_Buffer in = Munchar::load_file(src.path.c_str());
+  if (!in.ok()) {
+    r.error = strerror(in.error());
+  }
+  else {
+    tokens.clear();
+    size_t stop = 0;
+    bool ok = src.grammar == tritium ? lex(Tritium::Scanner { }, in.begin(), in.end(), tokens, stop)
+                                     : lex(Sass::Tokens::Scanner { }, in.begin(), in.end(), tokens, stop);
+    if (!ok) {
+      size_t line = 1 + std::count(in.begin(), in.begin() + stop, '\n');
+      const char* nl = static_cast<const char*>(memrchr(in.begin(), '\n', stop));
+      size_t col = 1 + (in.begin() + stop - (nl ? nl+1 : in.begin()));
+      r.error = std::to_string(line) + ":" + std::to_string(col) + ": cannot lex";
+    }
+    r.bytes = in.size();
+    r.tokens = tokens.size();
+  }
+  r.usec = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  return r;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = size_t(p / 100 * sorted.size() + 0.5);
+  return sorted[std::min(std::max(i, size_t(1)), sorted.size()) - 1];
+}
+
+void usage() {
+  std::cerr << "usage: munch [-j threads] [-n slowest] path..." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t slowest = 10;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:n:h")) != -1) {
+    switch (opt) {
+      case 'j': threads = std::max(1L, strtol(optarg, nullptr, 10)); break;
+      case 'n': slowest = std::max(0L, strtol(optarg, nullptr, 10)); break;
+      default: usage(); return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (optind == argc) {
+    usage();
+    return 2;
+  }
+
+  std::vector<Source> sources;
+  std::vector<std::string> problems;
+  for (int i = optind; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.find_first_of("*?[") == std::string::npos) {
+      collect(arg, true, sources, problems);
+      continue;
+    }
+    glob_t g;
+    if (glob(arg.c_str(), 0, nullptr, std::addressof(g)) != 0) {
+      problems.push_back(arg + ": no matches");
+      continue;
+    }
+    for (size_t k = 0; k < g.gl_pathc; ++k) collect(g.gl_pathv[k], false, sources, problems);
+    globfree(std::addressof(g));
+  }
+
+  // Largest files first, dealt out in turn.
+  std::vector<size_t> order(sources.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sources[a].size > sources[b].size;
+  });
+  threads = std::max(size_t(1), std::min(threads, sources.size()));
+  std::vector<Work_Queue> queues(threads);
+  for (size_t i = order.size(); i-- > 0; ) queues[i % threads].push(order[i]);
+
+  std::vector<Worker> workers(threads);
+  auto t0 = std::chrono::steady_clock::now();
+  auto work = [&](size_t id) {
+    Worker& w = workers[id];
+    for (;;) {
+      size_t f;
+      bool found = queues[id].pop(f);
+      // Nothing is added once the pool starts, so empty everywhere means done.
+      for (size_t k = 1; k < threads && !found; ++k) found = queues[(id+k) % threads].steal(f);
+      if (!found) return;
+      w.results.push_back(munch(sources[f], f, w.tokens));
+    }
+  };
+  std::vector<std::thread> pool;
+  for (size_t id = 1; id < threads; ++id) pool.emplace_back(work, id);
+  work(0);
+  for (auto& t : pool) t.join();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  std::vector<Result> results;
+  for (auto& w : workers) results.insert(results.end(), w.results.begin(), w.results.end());
+  size_t bytes = 0, tokens = 0;
+  std::vector<double> times;
+  for (auto& r : results) {
+    bytes += r.bytes;
+    tokens += r.tokens;
+    times.push_back(r.usec);
+    if (!r.error.empty()) problems.push_back(sources[r.file].path + ":" + r.error);
+  }
+  std::sort(times.begin(), times.end());
+  std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+    return a.usec > b.usec;
+  });
+
+  printf("%zu files, %.1f MB, %zu tokens in %.3f s on %zu threads\n",
+         results.size(), bytes / 1e6, tokens, wall, threads);
+  if (wall > 0) printf("throughput: %.1f MB/s, %.2f Mtokens/s\n", bytes / 1e6 / wall, tokens / 1e6 / wall);
+  printf("per file (usec): p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+         percentile(times, 50), percentile(times, 90), percentile(times, 99), percentile(times, 100));
+  if (slowest && !results.empty()) {
+    printf("slowest:\n");
+    for (size_t i = 0; i < slowest && i < results.size(); ++i) {
+      const Result& r = results[i];
+      printf("  %10.1f usec  %10zu bytes  %s\n", r.usec, r.bytes, sources[r.file].path.c_str());
+    }
+  }
+  for (auto& p : problems) fprintf(stderr, "error: %s\n", p.c_str());
+  return problems.empty() ? 0 : 1;
+}